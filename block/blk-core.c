@@ -35,6 +35,8 @@
 #include <trace/events/block.h>
 
 #include "blk.h"
+#include "blk-wbt.h"
+#include "blk-lat-hist.h"
 
 EXPORT_TRACEPOINT_SYMBOL_GPL(block_bio_remap);
 EXPORT_TRACEPOINT_SYMBOL_GPL(block_rq_remap);
@@ -1207,6 +1209,7 @@ void __blk_put_request(struct request_queue *q, struct request *req)
 	if (unlikely(--req->ref_count))
 		return;
 
+	wbt_done(q, req);
 	elv_completed_request(q, req);
 
 	/* this is a bio leak */
@@ -1388,6 +1391,7 @@ void init_request_from_bio(struct request *req, struct bio *bio)
 	req->__sector = bio->bi_sector;
 	req->ioprio = bio_prio(bio);
 	blk_rq_bio_prep(req->q, req, bio);
+	blk_lat_hist_start(req);
 }
 EXPORT_SYMBOL(init_request_from_bio);
 
@@ -1398,6 +1402,7 @@ void blk_queue_bio(struct request_queue *q, struct bio *bio)
 	int el_ret, rw_flags, where = ELEVATOR_INSERT_SORT;
 	struct request *req;
 	unsigned int request_count = 0;
+	bool wb_acct;
 
 	/*
 	 * low level driver can indicate that it wants pages above a
@@ -1439,6 +1444,12 @@ void blk_queue_bio(struct request_queue *q, struct bio *bio)
 	}
 
 get_rq:
+	/*
+	 * Background writeback may have to wait here for the device to
+	 * make room for reads.  Drops and retakes the queue lock.
+	 */
+	wb_acct = wbt_wait(q, bio);
+
 	/*
 	 * This sync check and mask will be re-done in init_request_from_bio(),
 	 * but we need to set it earlier to expose the sync flag to the
@@ -1454,10 +1465,14 @@ get_rq:
 	 */
 	req = get_request_wait(q, rw_flags, bio);
 	if (unlikely(!req)) {
+		if (wb_acct)
+			__wbt_done(q);
 		bio_endio(bio, -ENODEV);	/* @q is dead */
 		goto out_unlock;
 	}
 
+	wbt_track(req, wb_acct);
+
 	/*
 	 * After dropping the lock and possibly sleeping here, our request
 	 * may now be mergeable after it had proven unmergeable (above).
@@ -2105,6 +2120,9 @@ void blk_dequeue_request(struct request *rq)
 		q->in_flight[rq_is_sync(rq)]++;
 		set_io_start_time_ns(rq);
 	}
+
+	wbt_issue(q, rq);
+	blk_lat_hist_issue(q, rq);
 }
 
 /**
@@ -2397,6 +2415,8 @@ static void blk_finish_request(struct request *req, int error)
 
 
 	blk_account_io_done(req);
+	wbt_done(req->q, req);
+	blk_lat_hist_done(req->q, req);
 
 	if (req->end_io)
 		req->end_io(req, error);
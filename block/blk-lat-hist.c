@@ -0,0 +1,134 @@
+/*
+ * Per-queue request latency histograms.
+ *
+ * Every filesystem request is timed when it is set up from a bio, when
+ * the driver takes it off the queue and when it completes.  The time
+ * spent in the queue and the time spent in the device are counted in
+ * log2 buckets of microseconds, per direction, in per-cpu counters that
+ * are summed up when /sys/block/<dev>/queue/latency_hist is read.
+ * Writing to that file clears the counters.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/blkdev.h>
+#include <linux/bitops.h>
+#include <linux/ktime.h>
+#include <linux/percpu.h>
+
+#include "blk-lat-hist.h"
+
+static inline u64 lat_hist_now(void)
+{
+	return ktime_to_ns(ktime_get());
+}
+
+static unsigned int lat_hist_bucket(u64 nsecs)
+{
+	u64 usecs = div_u64(nsecs, NSEC_PER_USEC);
+
+	return min_t(unsigned int, fls64(usecs), BLK_LAT_HIST_BUCKETS - 1);
+}
+
+/*
+ * The request is set up from a bio.
+ */
+void blk_lat_hist_start(struct request *rq)
+{
+	if (rq->q->lat_hist)
+		rq->hist_start_ns = lat_hist_now();
+}
+
+/*
+ * The driver takes the request.  Called with the queue lock held.
+ */
+void blk_lat_hist_issue(struct request_queue *q, struct request *rq)
+{
+	if (q->lat_hist && rq->hist_start_ns)
+		rq->hist_issue_ns = lat_hist_now();
+}
+
+/*
+ * The request is done.  Called with the queue lock held.
+ */
+void blk_lat_hist_done(struct request_queue *q, struct request *rq)
+{
+	struct blk_lat_hist *hist;
+	int rw = rq_data_dir(rq);
+	u64 now;
+
+	if (!q->lat_hist || !rq->hist_issue_ns)
+		return;
+
+	now = lat_hist_now();
+	hist = per_cpu_ptr(q->lat_hist, smp_processor_id());
+	hist->buckets[rw][BLK_LAT_QUEUE]
+		[lat_hist_bucket(rq->hist_issue_ns - rq->hist_start_ns)]++;
+	hist->buckets[rw][BLK_LAT_DEVICE]
+		[lat_hist_bucket(now - rq->hist_issue_ns)]++;
+
+	rq->hist_start_ns = rq->hist_issue_ns = 0;
+}
+
+static unsigned long lat_hist_sum(struct request_queue *q, int rw, int stage,
+				  unsigned int bucket)
+{
+	unsigned long sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		sum += per_cpu_ptr(q->lat_hist, cpu)->buckets[rw][stage][bucket];
+	return sum;
+}
+
+ssize_t blk_lat_hist_show(struct request_queue *q, char *page)
+{
+	ssize_t len;
+	unsigned int i;
+
+	if (!q->lat_hist)
+		return -EINVAL;
+
+	len = sprintf(page, "%10s %12s %12s %12s %12s\n", "usecs<",
+		      "read_queue", "read_dev", "write_queue", "write_dev");
+	for (i = 0; i < BLK_LAT_HIST_BUCKETS; i++) {
+		if (i < BLK_LAT_HIST_BUCKETS - 1)
+			len += sprintf(page + len, "%10lu", 1UL << i);
+		else
+			len += sprintf(page + len, "%10s", "inf");
+		len += sprintf(page + len, " %12lu %12lu %12lu %12lu\n",
+			       lat_hist_sum(q, READ, BLK_LAT_QUEUE, i),
+			       lat_hist_sum(q, READ, BLK_LAT_DEVICE, i),
+			       lat_hist_sum(q, WRITE, BLK_LAT_QUEUE, i),
+			       lat_hist_sum(q, WRITE, BLK_LAT_DEVICE, i));
+	}
+	return len;
+}
+
+void blk_lat_hist_reset(struct request_queue *q)
+{
+	int cpu;
+
+	if (!q->lat_hist)
+		return;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(q->lat_hist, cpu), 0,
+		       sizeof(struct blk_lat_hist));
+}
+
+int blk_lat_hist_init(struct request_queue *q)
+{
+	if (!q->request_fn || q->lat_hist)
+		return 0;
+
+	q->lat_hist = alloc_percpu(struct blk_lat_hist);
+	if (!q->lat_hist)
+		return -ENOMEM;
+	return 0;
+}
+
+void blk_lat_hist_exit(struct request_queue *q)
+{
+	free_percpu(q->lat_hist);
+	q->lat_hist = NULL;
+}
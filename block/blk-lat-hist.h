@@ -0,0 +1,57 @@
+#ifndef BLK_LAT_HIST_H
+#define BLK_LAT_HIST_H
+
+#include <linux/kernel.h>
+#include <linux/percpu.h>
+
+/*
+ * Bucket 0 counts requests that took less than 1us, bucket i up to
+ * 2^i us, and the last bucket everything slower.
+ */
+#define BLK_LAT_HIST_BUCKETS	24
+
+enum {
+	BLK_LAT_QUEUE,		/* allocated until handed to the driver */
+	BLK_LAT_DEVICE,		/* handed to the driver until completed */
+	BLK_LAT_NR_STAGES,
+};
+
+struct blk_lat_hist {
+	unsigned long	buckets[2][BLK_LAT_NR_STAGES][BLK_LAT_HIST_BUCKETS];
+};
+
+#ifdef CONFIG_BLK_LAT_HIST
+
+int blk_lat_hist_init(struct request_queue *);
+void blk_lat_hist_exit(struct request_queue *);
+void blk_lat_hist_start(struct request *);
+void blk_lat_hist_issue(struct request_queue *, struct request *);
+void blk_lat_hist_done(struct request_queue *, struct request *);
+
+ssize_t blk_lat_hist_show(struct request_queue *, char *);
+void blk_lat_hist_reset(struct request_queue *);
+
+#else
+
+static inline int blk_lat_hist_init(struct request_queue *q)
+{
+	return 0;
+}
+static inline void blk_lat_hist_exit(struct request_queue *q)
+{
+}
+static inline void blk_lat_hist_start(struct request *rq)
+{
+}
+static inline void blk_lat_hist_issue(struct request_queue *q,
+				      struct request *rq)
+{
+}
+static inline void blk_lat_hist_done(struct request_queue *q,
+				     struct request *rq)
+{
+}
+
+#endif /* CONFIG_BLK_LAT_HIST */
+
+#endif
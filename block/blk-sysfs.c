@@ -9,6 +9,8 @@
 #include <linux/blktrace_api.h>
 
 #include "blk.h"
+#include "blk-wbt.h"
+#include "blk-lat-hist.h"
 
 struct queue_sysfs_entry {
 	struct attribute attr;
@@ -275,6 +277,60 @@ queue_rq_affinity_store(struct request_queue *q, const char *page, size_t count)
 	return ret;
 }
 
+#ifdef CONFIG_BLK_WBT
+static ssize_t queue_wb_lat_show(struct request_queue *q, char *page)
+{
+	if (!q->rq_wb)
+		return -EINVAL;
+
+	return sprintf(page, "%llu\n",
+		       (unsigned long long)div_u64(wbt_get_min_lat(q), 1000));
+}
+
+static ssize_t queue_wb_lat_store(struct request_queue *q, const char *page,
+				  size_t count)
+{
+	ssize_t ret;
+	s64 val;
+
+	ret = kstrtoll(page, 10, &val);
+	if (ret < 0)
+		return ret;
+	if (val < -1)
+		return -EINVAL;
+
+	if (!q->rq_wb)
+		return -EINVAL;
+
+	/* -1 restores the default for this kind of device, 0 disables */
+	if (val == -1)
+		val = wbt_default_latency_nsec(q);
+	else
+		val *= 1000ULL;
+
+	wbt_set_min_lat(q, val);
+	return count;
+}
+#endif
+
+#ifdef CONFIG_BLK_LAT_HIST
+static ssize_t queue_lat_hist_show(struct request_queue *q, char *page)
+{
+	return blk_lat_hist_show(q, page);
+}
+
+static ssize_t queue_lat_hist_store(struct request_queue *q,
+				    const char *page, size_t count)
+{
+	if (!q->lat_hist)
+		return -EINVAL;
+
+	/* any write clears the histograms */
+	blk_lat_hist_reset(q);
+	return count;
+}
+#endif
+
 static struct queue_sysfs_entry queue_requests_entry = {
 	.attr = {.name = "nr_requests", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_requests_show,
@@ -389,6 +445,22 @@ static struct queue_sysfs_entry queue_random_entry = {
 	.store = queue_store_random,
 };
 
+#ifdef CONFIG_BLK_WBT
+static struct queue_sysfs_entry queue_wb_lat_entry = {
+	.attr = {.name = "wbt_lat_usec", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_wb_lat_show,
+	.store = queue_wb_lat_store,
+};
+#endif
+
+#ifdef CONFIG_BLK_LAT_HIST
+static struct queue_sysfs_entry queue_lat_hist_entry = {
+	.attr = {.name = "latency_hist", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_lat_hist_show,
+	.store = queue_lat_hist_store,
+};
+#endif
+
 static struct attribute *default_attrs[] = {
 	&queue_requests_entry.attr,
 	&queue_ra_entry.attr,
@@ -411,6 +483,12 @@ static struct attribute *default_attrs[] = {
 	&queue_rq_affinity_entry.attr,
 	&queue_iostats_entry.attr,
 	&queue_random_entry.attr,
+#ifdef CONFIG_BLK_WBT
+	&queue_wb_lat_entry.attr,
+#endif
+#ifdef CONFIG_BLK_LAT_HIST
+	&queue_lat_hist_entry.attr,
+#endif
 	NULL,
 };
 
@@ -489,6 +567,8 @@ static void blk_release_queue(struct kobject *kobj)
 	}
 
 	blk_throtl_exit(q);
+	wbt_exit(q);
+	blk_lat_hist_exit(q);
 
 	if (rl->rq_pool)
 		mempool_destroy(rl->rq_pool);
@@ -540,6 +620,13 @@ int blk_register_queue(struct gendisk *disk)
 	if (!q->request_fn)
 		return 0;
 
+	/*
+	 * Set up writeback throttling now that the driver has told us
+	 * whether the device is rotational.
+	 */
+	wbt_init(q);
+	blk_lat_hist_init(q);
+
 	ret = elv_register_queue(q);
 	if (ret) {
 		kobject_uevent(&q->kobj, KOBJ_REMOVE);
@@ -0,0 +1,546 @@
+/*
+ * Buffered writeback throttling, loosely based on CoDel.
+ *
+ * Background writeback can fill the request queue of a slow device with
+ * hundreds of writes, and every read that arrives afterwards has to wait
+ * for them.  We can't cap the queue depth statically, since the right
+ * depth depends on the device and on the workload.
+ *
+ * Instead, the completion latency of reads is watched over a window of
+ * time.  If even the fastest read of a window took longer than the
+ * target, the number of background writes allowed in flight is halved,
+ * and the window shrinks so that we react faster.  While the target is
+ * met, or nobody is reading, the limit is raised again.
+ *
+ * Only writes that nobody waits for synchronously are throttled, which
+ * in this kernel is what WB_SYNC_NONE writeback submits: WB_SYNC_ALL,
+ * O_DIRECT and journal commits all set REQ_SYNC.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/blkdev.h>
+#include <linux/backing-dev.h>
+#include <linux/slab.h>
+#include <linux/swap.h>
+#include <linux/ktime.h>
+
+#include "blk-wbt.h"
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/wbt.h>
+
+enum {
+	/*
+	 * Default number of background writes in flight, before any
+	 * scaling is applied.
+	 */
+	RWB_DEF_DEPTH	= 16,
+
+	/*
+	 * 100msec window
+	 */
+	RWB_WINDOW_NSEC		= 100 * 1000 * 1000ULL,
+
+	/*
+	 * Disregard stats, if we don't meet this minimum
+	 */
+	RWB_MIN_WRITE_SAMPLES	= 3,
+
+	/*
+	 * If we have this number of consecutive windows with not enough
+	 * information to scale up or down, scale up.
+	 */
+	RWB_UNKNOWN_BUMP	= 5,
+};
+
+enum {
+	LAT_OK = 1,
+	LAT_UNKNOWN,
+	LAT_UNKNOWN_WRITES,
+	LAT_EXCEEDED,
+};
+
+static inline bool rwb_enabled(struct rq_wb *rwb)
+{
+	return rwb && rwb->min_lat_nsec;
+}
+
+static inline u64 wbt_now(void)
+{
+	return ktime_to_ns(ktime_get());
+}
+
+static void rwb_wake_all(struct rq_wb *rwb)
+{
+	if (waitqueue_active(&rwb->wait))
+		wake_up_all(&rwb->wait);
+}
+
+static void rwb_trace_step(struct rq_wb *rwb, const char *msg)
+{
+	trace_wbt_step(&rwb->queue->backing_dev_info, msg, rwb->scale_step,
+			rwb->cur_win_nsec, rwb->wb_background, rwb->wb_normal,
+			rwb->wb_max);
+}
+
+static unsigned int rwb_queue_depth(struct rq_wb *rwb)
+{
+	return max_t(unsigned int, 1,
+		     min_t(unsigned int, RWB_DEF_DEPTH,
+			   rwb->queue->nr_requests / 2));
+}
+
+static void calc_wb_limits(struct rq_wb *rwb)
+{
+	unsigned int depth = rwb_queue_depth(rwb);
+
+	if (!rwb->min_lat_nsec) {
+		rwb->wb_max = rwb->wb_normal = rwb->wb_background = 0;
+		return;
+	}
+
+	if (rwb->scale_step > 0) {
+		depth = 1 + ((depth - 1) >> min(31, rwb->scale_step));
+	} else if (rwb->scale_step < 0) {
+		unsigned int maxd = 3 * rwb->queue->nr_requests / 4;
+
+		depth = 1 + ((depth - 1) << min(31, -rwb->scale_step));
+		if (depth > maxd) {
+			depth = maxd;
+			rwb->scaled_max = true;
+		}
+	}
+
+	/*
+	 * Set our max/normal/bg queue depths based on how far we have
+	 * scaled down (->scale_step).
+	 */
+	rwb->wb_max = depth;
+	rwb->wb_normal = (rwb->wb_max + 1) / 2;
+	rwb->wb_background = (rwb->wb_max + 3) / 4;
+}
+
+static void scale_up(struct rq_wb *rwb)
+{
+	/*
+	 * Hit max in previous round, stop here
+	 */
+	if (rwb->scaled_max)
+		return;
+
+	rwb->scale_step--;
+	rwb->unknown_cnt = 0;
+	calc_wb_limits(rwb);
+
+	rwb_wake_all(rwb);
+	rwb_trace_step(rwb, "step up");
+}
+
+static void scale_down(struct rq_wb *rwb)
+{
+	/*
+	 * Stop scaling down when we've hit the limit. This also prevents
+	 * ->scale_step from going to crazy values, if the device can't
+	 * keep up.
+	 */
+	if (rwb->wb_max == 1)
+		return;
+
+	rwb->scale_step++;
+	rwb->scaled_max = false;
+	rwb->unknown_cnt = 0;
+	calc_wb_limits(rwb);
+	rwb_trace_step(rwb, "step down");
+}
+
+static void rwb_arm_timer(struct rq_wb *rwb)
+{
+	if (rwb->scale_step > 0) {
+		/*
+		 * We should speed this up, using some variant of a fast
+		 * integer inverse square root calculation. Since we only do
+		 * this for every window expiration, it's not a huge deal,
+		 * though.
+		 */
+		rwb->cur_win_nsec = div_u64(rwb->win_nsec << 4,
+					int_sqrt((rwb->scale_step + 1) << 8));
+	} else {
+		/*
+		 * For step < 0, we don't want to increase/decrease the
+		 * window size.
+		 */
+		rwb->cur_win_nsec = rwb->win_nsec;
+	}
+
+	mod_timer(&rwb->window_timer,
+		  jiffies + max(1UL, nsecs_to_jiffies(rwb->cur_win_nsec)));
+}
+
+static int latency_exceeded(struct rq_wb *rwb)
+{
+	struct rq_wb_stat *stat = &rwb->stat;
+
+	/*
+	 * If a read has been stuck for a whole window, or past the target
+	 * with nothing completing meanwhile, the writes are in the way even
+	 * if no read latency made it into the stats.
+	 */
+	if (rwb->sync_issue) {
+		u64 thislat = wbt_now() - rwb->sync_issue;
+
+		if (thislat > rwb->cur_win_nsec ||
+		    (thislat > rwb->min_lat_nsec && !stat->nr_reads)) {
+			trace_wbt_lat(&rwb->queue->backing_dev_info, thislat);
+			return LAT_EXCEEDED;
+		}
+	}
+
+	if (!stat->nr_reads) {
+		/*
+		 * Only writes going on: nothing to protect, so don't hold
+		 * them back.
+		 */
+		if (stat->nr_writes || rwb->inflight)
+			return LAT_UNKNOWN_WRITES;
+		return LAT_UNKNOWN;
+	}
+
+	/*
+	 * Reads alone, their latency is none of our doing.
+	 */
+	if (stat->nr_writes < RWB_MIN_WRITE_SAMPLES && !rwb->inflight)
+		return LAT_UNKNOWN;
+
+	/*
+	 * If the 'min' latency exceeds our target, step down.
+	 */
+	if (stat->min_read_lat > rwb->min_lat_nsec) {
+		trace_wbt_lat(&rwb->queue->backing_dev_info,
+			      stat->min_read_lat);
+		trace_wbt_stat(&rwb->queue->backing_dev_info, stat->nr_reads,
+			       stat->nr_writes, stat->min_read_lat);
+		return LAT_EXCEEDED;
+	}
+
+	if (rwb->scale_step)
+		trace_wbt_stat(&rwb->queue->backing_dev_info, stat->nr_reads,
+			       stat->nr_writes, stat->min_read_lat);
+
+	return LAT_OK;
+}
+
+static void wb_timer_fn(unsigned long data)
+{
+	struct rq_wb *rwb = (struct rq_wb *) data;
+	struct request_queue *q = rwb->queue;
+	unsigned long flags;
+	int status;
+
+	spin_lock_irqsave(q->queue_lock, flags);
+
+	if (!rwb_enabled(rwb))
+		goto out;
+
+	status = latency_exceeded(rwb);
+
+	trace_wbt_timer(&q->backing_dev_info, status, rwb->scale_step,
+			rwb->inflight);
+
+	/*
+	 * If we exceeded the latency target, step down. If we did not,
+	 * step one level up. If we don't know enough to say either exceeded
+	 * or ok, then don't do anything.
+	 */
+	switch (status) {
+	case LAT_EXCEEDED:
+		scale_down(rwb);
+		break;
+	case LAT_OK:
+		scale_up(rwb);
+		break;
+	case LAT_UNKNOWN_WRITES:
+		/*
+		 * We started a the center step, but don't have a valid
+		 * read/write sample, but we do have writes going on.
+		 * Allow step to go negative, to increase write perf.
+		 */
+		scale_up(rwb);
+		break;
+	case LAT_UNKNOWN:
+		if (++rwb->unknown_cnt < RWB_UNKNOWN_BUMP)
+			break;
+		/*
+		 * We get here when previously scaled reduced depth, and we
+		 * currently don't have a valid read/write sample. For that
+		 * case, slowly return to center state (step == 0).
+		 */
+		if (rwb->scale_step > 0)
+			scale_up(rwb);
+		else if (rwb->scale_step < 0)
+			scale_down(rwb);
+		break;
+	default:
+		break;
+	}
+
+	memset(&rwb->stat, 0, sizeof(rwb->stat));
+
+	/*
+	 * Re-arm timer, if we have IO in flight or are still away from
+	 * the default depth.
+	 */
+	if (rwb->scale_step || rwb->inflight)
+		rwb_arm_timer(rwb);
+out:
+	spin_unlock_irqrestore(q->queue_lock, flags);
+}
+
+/*
+ * Reads were issued or completed very recently, keep background
+ * writeback further out of their way.
+ */
+static bool close_io(struct rq_wb *rwb)
+{
+	const unsigned long now = jiffies;
+
+	return time_before(now, rwb->last_issue + HZ / 10) ||
+		time_before(now, rwb->last_comp + HZ / 10);
+}
+
+static unsigned int rwb_get_limit(struct rq_wb *rwb)
+{
+	/*
+	 * At this point we know it's a buffered write. If reclaim is
+	 * waiting for these pages to be cleaned, let it have the full
+	 * depth.
+	 */
+	if (current_is_kswapd())
+		return rwb->wb_max;
+	if (close_io(rwb))
+		return rwb->wb_background;
+	return rwb->wb_normal;
+}
+
+static bool may_queue(struct rq_wb *rwb)
+{
+	/*
+	 * Throttling was turned off, or the queue is going away while
+	 * we waited: let everything through, but keep counting.
+	 */
+	if (!rwb->min_lat_nsec || blk_queue_dead(rwb->queue) ||
+	    rwb->inflight < rwb_get_limit(rwb)) {
+		rwb->inflight++;
+		return true;
+	}
+
+	return false;
+}
+
+static void rwb_wake(struct rq_wb *rwb)
+{
+	unsigned int limit = rwb->wb_normal;
+	unsigned int inflight = rwb->inflight;
+
+	if (!waitqueue_active(&rwb->wait))
+		return;
+
+	/*
+	 * Don't wake anyone up until we have dropped a bit below the
+	 * limit, waking one writer per completion just means running
+	 * the queue at depth one.
+	 */
+	if (rwb->min_lat_nsec && inflight && inflight >= limit)
+		return;
+
+	if (!inflight || !rwb->min_lat_nsec ||
+	    limit - inflight >= rwb->wb_background / 2)
+		wake_up(&rwb->wait);
+}
+
+static bool wbt_should_throttle(struct bio *bio)
+{
+	if (!(bio->bi_rw & REQ_WRITE))
+		return false;
+
+	return !(bio->bi_rw & (REQ_SYNC | REQ_FLUSH | REQ_FUA | REQ_DISCARD));
+}
+
+/**
+ * wbt_wait - wait for room to queue a background write
+ * @q:		the request queue
+ * @bio:	the bio about to get a request
+ *
+ * Called with the queue lock held, which is dropped while sleeping.
+ * Returns true if the request for @bio must be tracked with wbt_track().
+ */
+bool wbt_wait(struct request_queue *q, struct bio *bio)
+{
+	struct rq_wb *rwb = q->rq_wb;
+	DEFINE_WAIT(wait);
+
+	if (!rwb_enabled(rwb) || !wbt_should_throttle(bio))
+		return false;
+
+	if (may_queue(rwb))
+		goto out;
+
+	do {
+		prepare_to_wait_exclusive(&rwb->wait, &wait,
+					  TASK_UNINTERRUPTIBLE);
+		if (may_queue(rwb))
+			break;
+
+		spin_unlock_irq(q->queue_lock);
+		io_schedule();
+		spin_lock_irq(q->queue_lock);
+	} while (1);
+
+	finish_wait(&rwb->wait, &wait);
+out:
+	if (!timer_pending(&rwb->window_timer))
+		rwb_arm_timer(rwb);
+	return true;
+}
+
+/*
+ * A request is handed to the driver.  Called with the queue lock held.
+ */
+void wbt_issue(struct request_queue *q, struct request *rq)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	if (!rwb_enabled(rwb) || rq->cmd_type != REQ_TYPE_FS ||
+	    !blk_rq_bytes(rq))
+		return;
+
+	rq->wbt_issue_ns = wbt_now();
+
+	if (rq_data_dir(rq) == READ) {
+		rwb->last_issue = jiffies;
+		if (!rwb->sync_issue) {
+			rwb->sync_issue = rq->wbt_issue_ns;
+			rwb->sync_cookie = rq;
+		}
+	}
+}
+
+/*
+ * Drop a write accounted by wbt_wait().  Called with the queue lock held.
+ */
+void __wbt_done(struct request_queue *q)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	rwb->inflight--;
+	rwb_wake(rwb);
+}
+
+/*
+ * A request is done.  Called with the queue lock held, possibly more
+ * than once for the same request.
+ */
+void wbt_done(struct request_queue *q, struct request *rq)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	if (!rwb)
+		return;
+
+	if (rq->wbt_flags & WBT_TRACKED)
+		__wbt_done(q);
+
+	if (rq->wbt_issue_ns) {
+		u64 lat = wbt_now() - rq->wbt_issue_ns;
+		struct rq_wb_stat *stat = &rwb->stat;
+
+		if (rq_data_dir(rq) == READ) {
+			if (!stat->nr_reads || lat < stat->min_read_lat)
+				stat->min_read_lat = lat;
+			stat->nr_reads++;
+			rwb->last_comp = jiffies;
+		} else
+			stat->nr_writes++;
+	}
+
+	if (rwb->sync_cookie == rq) {
+		rwb->sync_issue = 0;
+		rwb->sync_cookie = NULL;
+	}
+
+	rq->wbt_flags = 0;
+	rq->wbt_issue_ns = 0;
+}
+
+u64 wbt_get_min_lat(struct request_queue *q)
+{
+	return q->rq_wb ? q->rq_wb->min_lat_nsec : 0;
+}
+
+void wbt_set_min_lat(struct request_queue *q, u64 val)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	if (!rwb)
+		return;
+
+	spin_lock_irq(q->queue_lock);
+	rwb->min_lat_nsec = val;
+	rwb->scale_step = 0;
+	rwb->scaled_max = false;
+	rwb->unknown_cnt = 0;
+	calc_wb_limits(rwb);
+	rwb_wake_all(rwb);
+	spin_unlock_irq(q->queue_lock);
+
+	trace_wbt_lat(&q->backing_dev_info, val);
+}
+
+/*
+ * We default to 2msec for non-rotational storage, and 75msec
+ * for rotational storage.
+ */
+u64 wbt_default_latency_nsec(struct request_queue *q)
+{
+	if (blk_queue_nonrot(q))
+		return 2000000ULL;
+	else
+		return 75000000ULL;
+}
+
+int wbt_init(struct request_queue *q)
+{
+	struct rq_wb *rwb;
+
+	if (!q->request_fn || q->rq_wb)
+		return 0;
+
+	rwb = kzalloc(sizeof(*rwb), GFP_KERNEL);
+	if (!rwb)
+		return -ENOMEM;
+
+	init_waitqueue_head(&rwb->wait);
+	setup_timer(&rwb->window_timer, wb_timer_fn, (unsigned long) rwb);
+	rwb->win_nsec = RWB_WINDOW_NSEC;
+	rwb->cur_win_nsec = RWB_WINDOW_NSEC;
+	rwb->queue = q;
+	rwb->last_issue = rwb->last_comp = jiffies - HZ;
+	rwb->min_lat_nsec = wbt_default_latency_nsec(q);
+
+	spin_lock_irq(q->queue_lock);
+	calc_wb_limits(rwb);
+	q->rq_wb = rwb;
+	spin_unlock_irq(q->queue_lock);
+
+	return 0;
+}
+
+void wbt_exit(struct request_queue *q)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	if (rwb) {
+		del_timer_sync(&rwb->window_timer);
+		q->rq_wb = NULL;
+		kfree(rwb);
+	}
+}
@@ -0,0 +1,106 @@
+#ifndef BLK_WBT_H
+#define BLK_WBT_H
+
+#include <linux/kernel.h>
+#include <linux/wait.h>
+#include <linux/timer.h>
+
+/* rq->wbt_flags */
+enum {
+	WBT_TRACKED	= 1,	/* counted in rq_wb->inflight */
+};
+
+/* completions seen during one monitoring window */
+struct rq_wb_stat {
+	unsigned int	nr_reads;
+	unsigned int	nr_writes;
+	u64		min_read_lat;	/* nsecs */
+};
+
+/*
+ * Per-queue writeback throttling state.  Everything below is protected
+ * by the queue lock.
+ */
+struct rq_wb {
+	/*
+	 * Current limits on background writes in flight, derived from
+	 * scale_step: positive steps throttle harder, negative ones
+	 * allow more than the default depth.
+	 */
+	unsigned int		wb_background;
+	unsigned int		wb_normal;
+	unsigned int		wb_max;
+	int			scale_step;
+	bool			scaled_max;
+
+	/* windows in a row without enough samples to judge */
+	unsigned int		unknown_cnt;
+
+	u64			win_nsec;	/* default window size */
+	u64			cur_win_nsec;	/* current window size */
+	u64			min_lat_nsec;	/* read latency target, 0 = off */
+
+	struct timer_list	window_timer;
+	struct rq_wb_stat	stat;
+
+	/* oldest read still in flight, to catch reads that never finish */
+	u64			sync_issue;
+	struct request		*sync_cookie;
+
+	/* last read issue and completion, in jiffies */
+	unsigned long		last_issue;
+	unsigned long		last_comp;
+
+	unsigned int		inflight;
+	wait_queue_head_t	wait;
+	struct request_queue	*queue;
+};
+
+#ifdef CONFIG_BLK_WBT
+
+int wbt_init(struct request_queue *);
+void wbt_exit(struct request_queue *);
+bool wbt_wait(struct request_queue *, struct bio *);
+void wbt_issue(struct request_queue *, struct request *);
+void __wbt_done(struct request_queue *);
+void wbt_done(struct request_queue *, struct request *);
+
+u64 wbt_get_min_lat(struct request_queue *);
+void wbt_set_min_lat(struct request_queue *, u64);
+u64 wbt_default_latency_nsec(struct request_queue *);
+
+static inline void wbt_track(struct request *rq, bool tracked)
+{
+	if (tracked)
+		rq->wbt_flags |= WBT_TRACKED;
+}
+
+#else
+
+static inline int wbt_init(struct request_queue *q)
+{
+	return -EINVAL;
+}
+static inline void wbt_exit(struct request_queue *q)
+{
+}
+static inline bool wbt_wait(struct request_queue *q, struct bio *bio)
+{
+	return false;
+}
+static inline void wbt_issue(struct request_queue *q, struct request *rq)
+{
+}
+static inline void __wbt_done(struct request_queue *q)
+{
+}
+static inline void wbt_done(struct request_queue *q, struct request *rq)
+{
+}
+static inline void wbt_track(struct request *rq, bool tracked)
+{
+}
+
+#endif /* CONFIG_BLK_WBT */
+
+#endif
@@ -76,6 +76,8 @@
 #include <linux/sysfs.h>
 #include <linux/miscdevice.h>
 #include <linux/falloc.h>
+#include <linux/mempool.h>
+#include <linux/vmalloc.h>
 
 #include <asm/uaccess.h>
 
@@ -458,6 +460,553 @@ out:
 	return ret;
 }
 
+/*
+ * Direct I/O
+ *
+ * Once the backing file has been checked to be fully allocated, its
+ * block map is captured and bios are remapped straight onto the device
+ * underneath it.  This bypasses both the page cache of the backing file
+ * and the loop thread, so requests are submitted asynchronously and as
+ * many of them can be in flight as the lower device allows.  The rules
+ * are those of a swap file: while direct I/O is enabled the backing
+ * file must not be truncated, hole-punched or have its blocks moved,
+ * so it is marked S_SWAPFILE for as long as the block map exists.
+ *
+ * Writes never go through the page cache of the backing file, and
+ * nothing invalidates it as they complete: buffered readers of the
+ * image see stale data until direct I/O is switched off again, at
+ * which point the cache is dropped.
+ */
+struct loop_dio_extent {
+	sector_t	start;		/* first loop device sector */
+	sector_t	nr_sects;
+	sector_t	disk_sect;	/* first sector on the lower device */
+};
+
+struct loop_dio_map {
+	struct block_device	*bdev;
+	struct inode		*inode;		/* marked S_SWAPFILE, or NULL */
+	sector_t		nr_sects;
+	unsigned int		nr_extents;
+	struct loop_dio_extent	extents[0];
+};
+
+/* tracks the clones of one loop bio on the direct path */
+struct loop_dio_io {
+	struct loop_device	*lo;
+	struct bio		*bio;
+	atomic_t		remaining;
+	int			error;
+};
+
+#define LOOP_DIO_MIN_IOS	16
+
+static struct bio_set *loop_dio_bio_set;
+static mempool_t *loop_dio_io_pool;
+
+static struct loop_dio_extent *loop_dio_lookup(struct loop_dio_map *map,
+					       sector_t sector)
+{
+	unsigned int first = 0, last = map->nr_extents;
+
+	while (last - first > 1) {
+		unsigned int mid = (first + last) / 2;
+
+		if (map->extents[mid].start <= sector)
+			first = mid;
+		else
+			last = mid;
+	}
+	return &map->extents[first];
+}
+
+static void loop_dio_put(struct loop_dio_io *io)
+{
+	struct loop_device *lo = io->lo;
+
+	if (!atomic_dec_and_test(&io->remaining))
+		return;
+
+	bio_endio(io->bio, io->error);
+	mempool_free(io, loop_dio_io_pool);
+	if (atomic_dec_and_test(&lo->lo_dio_inflight))
+		wake_up(&lo->lo_dio_wait);
+}
+
+static void loop_dio_bio_destructor(struct bio *clone)
+{
+	bio_free(clone, loop_dio_bio_set);
+}
+
+static void loop_dio_end_io(struct bio *clone, int error)
+{
+	struct loop_dio_io *io = clone->bi_private;
+
+	if (!error && !test_bit(BIO_UPTODATE, &clone->bi_flags))
+		error = -EIO;
+	if (error)
+		io->error = error;
+
+	bio_put(clone);
+	loop_dio_put(io);
+}
+
+static struct bio *loop_dio_alloc_clone(struct loop_dio_map *map,
+					struct loop_dio_io *io,
+					unsigned long rw, sector_t sector,
+					unsigned int nr_vecs)
+{
+	struct bio *clone;
+
+	clone = bio_alloc_bioset(GFP_NOIO, nr_vecs, loop_dio_bio_set);
+	clone->bi_destructor = loop_dio_bio_destructor;
+	clone->bi_sector = sector;
+	clone->bi_bdev = map->bdev;
+	clone->bi_rw = rw;
+	clone->bi_end_io = loop_dio_end_io;
+	clone->bi_private = io;
+	return clone;
+}
+
+static void loop_dio_submit_clone(struct loop_dio_io *io, struct bio *clone)
+{
+	atomic_inc(&io->remaining);
+	generic_make_request(clone);
+}
+
+static struct loop_dio_io *loop_dio_alloc_io(struct loop_device *lo,
+					     struct bio *bio)
+{
+	struct loop_dio_io *io;
+
+	io = mempool_alloc(loop_dio_io_pool, GFP_NOIO);
+	io->lo = lo;
+	io->bio = bio;
+	io->error = 0;
+	atomic_set(&io->remaining, 1);
+	return io;
+}
+
+/*
+ * Fast path for make_request: send @bio down as a single clone if it
+ * lies within one extent and the lower queue takes it whole.  Clones
+ * submitted from make_request are only queued on current->bio_list, so
+ * allocating a second one here could wait forever on a bioset that our
+ * own unissued clones have emptied.  Anything that needs splitting is
+ * left to the loop thread.  Returns false if @bio was not submitted.
+ */
+static bool loop_dio_submit_single(struct loop_device *lo,
+				   struct loop_dio_map *map, struct bio *bio)
+{
+	struct loop_dio_extent *ext;
+	struct loop_dio_io *io;
+	struct bio *clone;
+	struct bio_vec *bvec;
+	sector_t sector = bio->bi_sector;
+	int i;
+
+	if (unlikely(bio->bi_rw & REQ_DISCARD))
+		return false;
+	if (unlikely(sector + bio_sectors(bio) > map->nr_sects))
+		return false;
+
+	ext = loop_dio_lookup(map, sector);
+	if (sector + bio_sectors(bio) > ext->start + ext->nr_sects)
+		return false;
+
+	io = loop_dio_alloc_io(lo, bio);
+	clone = loop_dio_alloc_clone(map, io, bio->bi_rw,
+				     ext->disk_sect + sector - ext->start,
+				     bio->bi_vcnt);
+	bio_for_each_segment(bvec, bio, i) {
+		if (bio_add_page(clone, bvec->bv_page, bvec->bv_len,
+				 bvec->bv_offset) < bvec->bv_len) {
+			bio_put(clone);
+			mempool_free(io, loop_dio_io_pool);
+			return false;
+		}
+	}
+	loop_dio_submit_clone(io, clone);
+	loop_dio_put(io);
+	return true;
+}
+
+/*
+ * Split @bio along the extents of @map and send the pieces to the lower
+ * device.  The caller has accounted the bio in lo_dio_inflight, which
+ * pins @map until the last piece completes.  Only called from the loop
+ * thread, where each clone is issued before the next is allocated.
+ */
+static void loop_dio_submit(struct loop_device *lo, struct loop_dio_map *map,
+			    struct bio *bio)
+{
+	struct loop_dio_extent *ext;
+	struct loop_dio_io *io;
+	struct bio *clone = NULL;
+	struct bio_vec *bvec;
+	unsigned long rw = bio->bi_rw;
+	sector_t sector = bio->bi_sector;
+	int i;
+
+	io = loop_dio_alloc_io(lo, bio);
+
+	/* a discard would punch holes under the block map */
+	if (unlikely(rw & REQ_DISCARD)) {
+		io->error = -EOPNOTSUPP;
+		goto out;
+	}
+
+	if (unlikely(sector + bio_sectors(bio) > map->nr_sects)) {
+		io->error = -EIO;
+		goto out;
+	}
+
+	/* an empty flush has nothing to split, just pass it down */
+	if (!bio->bi_size) {
+		clone = loop_dio_alloc_clone(map, io, rw, 0, 0);
+		loop_dio_submit_clone(io, clone);
+		goto out;
+	}
+
+	ext = loop_dio_lookup(map, sector);
+	bio_for_each_segment(bvec, bio, i) {
+		unsigned int offset = bvec->bv_offset;
+		unsigned int len = bvec->bv_len;
+
+		while (len) {
+			sector_t left = ext->start + ext->nr_sects - sector;
+			unsigned int this_len = len;
+
+			if ((this_len >> 9) > left)
+				this_len = left << 9;
+
+			if (!clone)
+				clone = loop_dio_alloc_clone(map, io, rw,
+					ext->disk_sect + sector - ext->start,
+					bio->bi_vcnt);
+
+			if (bio_add_page(clone, bvec->bv_page, this_len,
+					 offset) < this_len) {
+				if (!clone->bi_vcnt) {
+					bio_put(clone);
+					io->error = -EIO;
+					goto out;
+				}
+				/* the lower queue is full, start a new clone */
+				loop_dio_submit_clone(io, clone);
+				clone = NULL;
+				rw &= ~REQ_FLUSH;
+				continue;
+			}
+
+			offset += this_len;
+			len -= this_len;
+			sector += this_len >> 9;
+
+			if (sector == ext->start + ext->nr_sects) {
+				loop_dio_submit_clone(io, clone);
+				clone = NULL;
+				rw &= ~REQ_FLUSH;
+				ext++;
+			}
+		}
+	}
+	if (clone)
+		loop_dio_submit_clone(io, clone);
+out:
+	loop_dio_put(io);
+}
+
+static struct loop_dio_map *loop_dio_alloc_map(unsigned int nr_extents)
+{
+	struct loop_dio_map *map;
+
+	map = vzalloc(sizeof(*map) +
+		      nr_extents * sizeof(struct loop_dio_extent));
+	if (map)
+		map->nr_extents = nr_extents;
+	return map;
+}
+
+/*
+ * Pin the blocks of a regular backing file the way swapon does, so
+ * truncate, hole punching and extent moves are refused while the block
+ * map is in use.
+ */
+static int loop_dio_protect(struct inode *inode)
+{
+	int error = 0;
+
+	mutex_lock(&inode->i_mutex);
+	if (IS_SWAPFILE(inode))
+		error = -EBUSY;
+	else
+		inode->i_flags |= S_SWAPFILE;
+	mutex_unlock(&inode->i_mutex);
+	return error;
+}
+
+static void loop_dio_unprotect(struct inode *inode)
+{
+	mutex_lock(&inode->i_mutex);
+	inode->i_flags &= ~S_SWAPFILE;
+	mutex_unlock(&inode->i_mutex);
+}
+
+static void loop_dio_free_map(struct loop_dio_map *map)
+{
+	if (map->inode)
+		loop_dio_unprotect(map->inode);
+	vfree(map);
+}
+
+/*
+ * Walk @nr_blocks file blocks starting at @first with bmap() and merge
+ * them into extents.  Returns the number of extents found, and fills
+ * them in if @map is given.  Holes are not allowed.
+ */
+static int loop_dio_scan(struct inode *inode, sector_t first,
+			 sector_t nr_blocks, struct loop_dio_map *map)
+{
+	unsigned int shift = inode->i_blkbits - 9;
+	struct loop_dio_extent cur = { 0, 0, 0 };
+	unsigned int nr = 0;
+	sector_t i, block;
+
+	for (i = 0; i < nr_blocks; i++) {
+		block = bmap(inode, first + i);
+		if (!block)
+			return -EINVAL;
+
+		if (cur.nr_sects &&
+		    cur.disk_sect + cur.nr_sects == (block << shift)) {
+			cur.nr_sects += 1 << shift;
+			continue;
+		}
+
+		if (cur.nr_sects) {
+			if (map) {
+				if (nr >= map->nr_extents)
+					return -EBUSY;
+				map->extents[nr] = cur;
+			}
+			nr++;
+		}
+		cur.start = i << shift;
+		cur.nr_sects = 1 << shift;
+		cur.disk_sect = block << shift;
+		cond_resched();
+	}
+
+	if (map) {
+		if (nr >= map->nr_extents)
+			return -EBUSY;
+		map->extents[nr] = cur;
+	}
+	nr++;
+
+	if (map && nr != map->nr_extents)
+		return -EBUSY;
+	return nr;
+}
+
+#define LOOP_DIO_FIEMAP_EXTENTS	32
+
+/*
+ * bmap() cannot tell preallocated extents from written ones, and reading
+ * those through the block map would expose stale disk contents.  Ask the
+ * filesystem, if it can tell, that the range is plain written data.
+ */
+static int loop_dio_check_fiemap(struct inode *inode, u64 start, u64 len)
+{
+	struct fiemap_extent_info fieinfo;
+	struct fiemap_extent *fe;
+	mm_segment_t old_fs;
+	unsigned int i;
+	int error = 0;
+
+	if (!inode->i_op->fiemap)
+		return 0;
+
+	fe = kmalloc(LOOP_DIO_FIEMAP_EXTENTS * sizeof(*fe), GFP_KERNEL);
+	if (!fe)
+		return -ENOMEM;
+
+	while (len) {
+		memset(&fieinfo, 0, sizeof(fieinfo));
+		fieinfo.fi_extents_max = LOOP_DIO_FIEMAP_EXTENTS;
+		fieinfo.fi_extents_start = (struct fiemap_extent __user *)fe;
+
+		old_fs = get_fs();
+		set_fs(get_ds());
+		error = inode->i_op->fiemap(inode, &fieinfo, start, len);
+		set_fs(old_fs);
+		if (error)
+			break;
+
+		error = -EINVAL;
+		if (!fieinfo.fi_extents_mapped)
+			break;
+
+		for (i = 0; i < fieinfo.fi_extents_mapped && len; i++) {
+			u64 end = fe[i].fe_logical + fe[i].fe_length;
+
+			if (fe[i].fe_logical > start || end <= start)
+				goto out;
+			if (fe[i].fe_flags & (FIEMAP_EXTENT_UNKNOWN |
+					      FIEMAP_EXTENT_DELALLOC |
+					      FIEMAP_EXTENT_ENCODED |
+					      FIEMAP_EXTENT_DATA_ENCRYPTED |
+					      FIEMAP_EXTENT_NOT_ALIGNED |
+					      FIEMAP_EXTENT_DATA_INLINE |
+					      FIEMAP_EXTENT_DATA_TAIL |
+					      FIEMAP_EXTENT_UNWRITTEN |
+					      FIEMAP_EXTENT_SHARED))
+				goto out;
+
+			len -= min(len, end - start);
+			start = end;
+		}
+		if (len && (fe[i - 1].fe_flags & FIEMAP_EXTENT_LAST))
+			goto out;
+		error = 0;
+		cond_resched();
+	}
+out:
+	kfree(fe);
+	return error;
+}
+
+/*
+ * Build the block map of the part of the backing file the loop device
+ * covers.  Block device backing is a single extent; regular files need
+ * a filesystem that supports bmap() and must be fully allocated.
+ */
+static int loop_dio_build_map(struct loop_device *lo,
+			      struct loop_dio_map **mapp)
+{
+	struct file *file = lo->lo_backing_file;
+	struct inode *inode = file->f_mapping->host;
+	sector_t nr_sects = get_capacity(lo->lo_disk);
+	unsigned int lbs = queue_logical_block_size(lo->lo_queue);
+	struct loop_dio_map *map;
+	sector_t first, nr_blocks;
+	int nr, error;
+
+	/* the data has to reach the disk exactly as it came in */
+	if (lo->transfer != transfer_none || !nr_sects)
+		return -EINVAL;
+
+	if (S_ISBLK(inode->i_mode)) {
+		struct block_device *bdev = inode->i_bdev;
+
+		if (bdev_logical_block_size(bdev) > lbs ||
+		    lo->lo_offset & (bdev_logical_block_size(bdev) - 1))
+			return -EINVAL;
+
+		map = loop_dio_alloc_map(1);
+		if (!map)
+			return -ENOMEM;
+		map->bdev = bdev;
+		map->extents[0].nr_sects = nr_sects;
+		map->extents[0].disk_sect = lo->lo_offset >> 9;
+		goto out;
+	}
+
+	if (!file->f_mapping->a_ops->bmap || !inode->i_sb->s_bdev)
+		return -EINVAL;
+	if (bdev_logical_block_size(inode->i_sb->s_bdev) > lbs ||
+	    lo->lo_offset & ((1 << inode->i_blkbits) - 1))
+		return -EINVAL;
+
+	/* the blocks must stay put from the first look onwards */
+	error = loop_dio_protect(inode);
+	if (error)
+		return error;
+
+	/* get delayed allocations onto the disk before looking */
+	error = filemap_write_and_wait(file->f_mapping);
+	if (error)
+		goto out_unprotect;
+
+	error = loop_dio_check_fiemap(inode, lo->lo_offset,
+				      (u64)nr_sects << 9);
+	if (error)
+		goto out_unprotect;
+
+	first = lo->lo_offset >> inode->i_blkbits;
+	nr_blocks = (((u64)nr_sects << 9) + (1 << inode->i_blkbits) - 1) >>
+		    inode->i_blkbits;
+
+	error = nr = loop_dio_scan(inode, first, nr_blocks, NULL);
+	if (nr < 0)
+		goto out_unprotect;
+	error = -ENOMEM;
+	map = loop_dio_alloc_map(nr);
+	if (!map)
+		goto out_unprotect;
+	error = nr = loop_dio_scan(inode, first, nr_blocks, map);
+	if (nr < 0) {
+		loop_dio_free_map(map);
+		goto out_unprotect;
+	}
+	map->bdev = inode->i_sb->s_bdev;
+	map->inode = inode;
+out:
+	map->nr_sects = nr_sects;
+	*mapp = map;
+	return 0;
+
+out_unprotect:
+	loop_dio_unprotect(inode);
+	return error;
+}
+
+/*
+ * Stop direct I/O and wait for the bios already on the direct path.
+ * Called from the loop thread, or after it has been stopped.
+ */
+static void loop_dio_drain(struct loop_device *lo)
+{
+	struct loop_dio_map *map;
+
+	spin_lock_irq(&lo->lo_lock);
+	map = lo->lo_dio;
+	lo->lo_dio = NULL;
+	spin_unlock_irq(&lo->lo_lock);
+
+	if (map) {
+		wait_event(lo->lo_dio_wait,
+			   !atomic_read(&lo->lo_dio_inflight));
+		loop_dio_free_map(map);
+	}
+}
+
+/*
+ * Called from the loop thread once every bio queued before the switch
+ * has been handled, so no request is ever in flight through both the
+ * page cache and the block map at once.
+ */
+static void loop_dio_switch(struct loop_device *lo, struct loop_dio_map *map)
+{
+	struct address_space *mapping = lo->lo_backing_file->f_mapping;
+
+	loop_dio_drain(lo);
+
+	/*
+	 * Push out what was written through the page cache and drop the
+	 * cached copies, so neither path can see stale data afterwards.
+	 */
+	filemap_write_and_wait(mapping);
+	invalidate_inode_pages2(mapping);
+
+	if (map) {
+		spin_lock_irq(&lo->lo_lock);
+		lo->lo_dio = map;
+		spin_unlock_irq(&lo->lo_lock);
+	}
+}
+
 /*
  * Add bio to back of pending list
  */
@@ -489,6 +1038,21 @@ static void loop_make_request(struct request_queue *q, struct bio *old_bio)
 		goto out;
 	if (unlikely(rw == WRITE && (lo->lo_flags & LO_FLAGS_READ_ONLY)))
 		goto out;
+	if (lo->lo_dio && old_bio->bi_bdev) {
+		struct loop_dio_map *map = lo->lo_dio;
+
+		atomic_inc(&lo->lo_dio_inflight);
+		spin_unlock_irq(&lo->lo_lock);
+		if (loop_dio_submit_single(lo, map, old_bio))
+			return;
+
+		/* needs splitting, let the loop thread do it */
+		if (atomic_dec_and_test(&lo->lo_dio_inflight))
+			wake_up(&lo->lo_dio_wait);
+		spin_lock_irq(&lo->lo_lock);
+		if (lo->lo_state != Lo_bound)
+			goto out;
+	}
 	loop_add_bio(lo, old_bio);
 	wake_up(&lo->lo_event);
 	spin_unlock_irq(&lo->lo_lock);
@@ -501,16 +1065,23 @@ out:
 
 struct switch_request {
 	struct file *file;
+	struct loop_dio_map *dio;	/* new block map, if dio_switch */
+	bool dio_switch;
 	struct completion wait;
 };
 
 static void do_loop_switch(struct loop_device *, struct switch_request *);
+static int loop_set_dio(struct loop_device *lo, unsigned long arg);
 
 static inline void loop_handle_bio(struct loop_device *lo, struct bio *bio)
 {
 	if (unlikely(!bio->bi_bdev)) {
 		do_loop_switch(lo, bio->bi_private);
 		bio_put(bio);
+	} else if (lo->lo_dio) {
+		/* only this thread changes lo_dio while it runs */
+		atomic_inc(&lo->lo_dio_inflight);
+		loop_dio_submit(lo, lo->lo_dio, bio);
 	} else {
 		int ret = do_bio_filebacked(lo, bio);
 		bio_endio(bio, ret);
@@ -560,21 +1131,26 @@ static int loop_thread(void *data)
  * First it needs to flush existing IO, it does this by sending a magic
  * BIO down the pipe. The completion of this BIO does the actual switch.
  */
-static int loop_switch(struct loop_device *lo, struct file *file)
+static int __loop_switch(struct loop_device *lo, struct switch_request *w)
 {
-	struct switch_request w;
 	struct bio *bio = bio_alloc(GFP_KERNEL, 0);
 	if (!bio)
 		return -ENOMEM;
-	init_completion(&w.wait);
-	w.file = file;
-	bio->bi_private = &w;
+	init_completion(&w->wait);
+	bio->bi_private = w;
 	bio->bi_bdev = NULL;
 	loop_make_request(lo->lo_queue, bio);
-	wait_for_completion(&w.wait);
+	wait_for_completion(&w->wait);
 	return 0;
 }
 
+static int loop_switch(struct loop_device *lo, struct file *file)
+{
+	struct switch_request w = { .file = file };
+
+	return __loop_switch(lo, &w);
+}
+
 /*
  * Helper to flush the IOs in loop, but keeping loop thread running
  */
@@ -596,6 +1172,9 @@ static void do_loop_switch(struct loop_device *lo, struct switch_request *p)
 	struct file *old_file = lo->lo_backing_file;
 	struct address_space *mapping;
 
+	if (p->dio_switch)
+		loop_dio_switch(lo, p->dio);
+
 	/* if no new file, only flush of queued bios requested */
 	if (!file)
 		goto out;
@@ -653,6 +1232,11 @@ static int loop_change_fd(struct loop_device *lo, struct block_device *bdev,
 	if (get_loop_size(lo, file) != get_loop_size(lo, old_file))
 		goto out_putf;
 
+	/* the block map describes the old file */
+	error = loop_set_dio(lo, 0);
+	if (error)
+		goto out_putf;
+
 	/* and ... switch */
 	error = loop_switch(lo, file);
 	if (error)
@@ -743,11 +1327,19 @@ static ssize_t loop_attr_partscan_show(struct loop_device *lo, char *buf)
 	return sprintf(buf, "%s\n", partscan ? "1" : "0");
 }
 
+static ssize_t loop_attr_dio_show(struct loop_device *lo, char *buf)
+{
+	int dio = (lo->lo_flags & LO_FLAGS_DIRECT_IO);
+
+	return sprintf(buf, "%s\n", dio ? "1" : "0");
+}
+
 LOOP_ATTR_RO(backing_file);
 LOOP_ATTR_RO(offset);
 LOOP_ATTR_RO(sizelimit);
 LOOP_ATTR_RO(autoclear);
 LOOP_ATTR_RO(partscan);
+LOOP_ATTR_RO(dio);
 
 static struct attribute *loop_attrs[] = {
 	&loop_attr_backing_file.attr,
@@ -755,6 +1347,7 @@ static struct attribute *loop_attrs[] = {
 	&loop_attr_sizelimit.attr,
 	&loop_attr_autoclear.attr,
 	&loop_attr_partscan.attr,
+	&loop_attr_dio.attr,
 	NULL,
 };
 
@@ -785,10 +1378,12 @@ static void loop_config_discard(struct loop_device *lo)
 	 * We use punch hole to reclaim the free space used by the
 	 * image a.k.a. discard. However we do support discard if
 	 * encryption is enabled, because it may give an attacker
-	 * useful information.
+	 * useful information.  Punching holes is not possible either
+	 * while direct I/O relies on the block map of the file.
 	 */
 	if ((!file->f_op->fallocate) ||
-	    lo->lo_encrypt_key_size) {
+	    lo->lo_encrypt_key_size ||
+	    (lo->lo_flags & LO_FLAGS_DIRECT_IO)) {
 		q->limits.discard_granularity = 0;
 		q->limits.discard_alignment = 0;
 		q->limits.max_discard_sectors = 0;
@@ -992,6 +1587,7 @@ static int loop_clr_fd(struct loop_device *lo)
 	spin_unlock_irq(&lo->lo_lock);
 
 	kthread_stop(lo->lo_thread);
+	loop_dio_drain(lo);
 
 	spin_lock_irq(&lo->lo_lock);
 	lo->lo_backing_file = NULL;
@@ -1056,6 +1652,15 @@ loop_set_status(struct loop_device *lo, const struct loop_info64 *info)
 	if ((unsigned int) info->lo_encrypt_key_size > LO_KEY_SIZE)
 		return -EINVAL;
 
+	/* the block map only holds for the current geometry */
+	if (lo->lo_offset != info->lo_offset ||
+	    lo->lo_sizelimit != info->lo_sizelimit ||
+	    info->lo_encrypt_type) {
+		err = loop_set_dio(lo, 0);
+		if (err)
+			return err;
+	}
+
 	err = loop_release_xfer(lo);
 	if (err)
 		return err;
@@ -1263,6 +1868,9 @@ static int loop_set_capacity(struct loop_device *lo, struct block_device *bdev)
 	err = -ENXIO;
 	if (unlikely(lo->lo_state != Lo_bound))
 		goto out;
+	err = loop_set_dio(lo, 0);
+	if (unlikely(err))
+		goto out;
 	err = figure_loop_size(lo, lo->lo_offset, lo->lo_sizelimit);
 	if (unlikely(err))
 		goto out;
@@ -1278,6 +1886,54 @@ static int loop_set_capacity(struct loop_device *lo, struct block_device *bdev)
 	return err;
 }
 
+/*
+ * Turn direct I/O on or off.  Queued bios are drained through the loop
+ * thread first; discard is unavailable while direct I/O is on, since
+ * punching holes would invalidate the block map.
+ */
+static int loop_set_dio(struct loop_device *lo, unsigned long arg)
+{
+	struct switch_request w = { .dio_switch = true };
+	int error;
+
+	if (lo->lo_state != Lo_bound)
+		return -ENXIO;
+	if (!arg == !(lo->lo_flags & LO_FLAGS_DIRECT_IO))
+		return 0;
+
+	if (!arg) {
+		error = __loop_switch(lo, &w);
+		if (error)
+			return error;
+		lo->lo_flags &= ~LO_FLAGS_DIRECT_IO;
+		loop_config_discard(lo);
+		return 0;
+	}
+
+	/* no more discards, and none left in the queue, before mapping */
+	lo->lo_flags |= LO_FLAGS_DIRECT_IO;
+	loop_config_discard(lo);
+	error = loop_flush(lo);
+	if (error)
+		goto out_err;
+
+	error = loop_dio_build_map(lo, &w.dio);
+	if (error)
+		goto out_err;
+
+	error = __loop_switch(lo, &w);
+	if (error) {
+		loop_dio_free_map(w.dio);
+		goto out_err;
+	}
+	return 0;
+
+out_err:
+	lo->lo_flags &= ~LO_FLAGS_DIRECT_IO;
+	loop_config_discard(lo);
+	return error;
+}
+
 static int lo_ioctl(struct block_device *bdev, fmode_t mode,
 	unsigned int cmd, unsigned long arg)
 {
@@ -1321,6 +1977,11 @@ static int lo_ioctl(struct block_device *bdev, fmode_t mode,
 		if ((mode & FMODE_WRITE) || capable(CAP_SYS_ADMIN))
 			err = loop_set_capacity(lo, bdev);
 		break;
+	case LOOP_SET_DIRECT_IO:
+		err = -EPERM;
+		if ((mode & FMODE_WRITE) || capable(CAP_SYS_ADMIN))
+			err = loop_set_dio(lo, arg);
+		break;
 	default:
 		err = lo->ioctl ? lo->ioctl(lo, cmd, arg) : -EINVAL;
 	}
@@ -1475,6 +2136,7 @@ static int lo_compat_ioctl(struct block_device *bdev, fmode_t mode,
 		arg = (unsigned long) compat_ptr(arg);
 	case LOOP_SET_FD:
 	case LOOP_CHANGE_FD:
+	case LOOP_SET_DIRECT_IO:
 		err = lo_ioctl(bdev, mode, cmd, arg);
 		break;
 	default:
@@ -1667,6 +2329,7 @@ static int loop_add(struct loop_device **l, int i)
 	lo->lo_number		= i;
 	lo->lo_thread		= NULL;
 	init_waitqueue_head(&lo->lo_event);
+	init_waitqueue_head(&lo->lo_dio_wait);
 	spin_lock_init(&lo->lo_lock);
 	disk->major		= LOOP_MAJOR;
 	disk->first_minor	= i << part_shift;
@@ -1825,9 +2488,19 @@ static int __init loop_init(void)
 	struct loop_device *lo;
 	int err;
 
+	loop_dio_bio_set = bioset_create(LOOP_DIO_MIN_IOS, 0);
+	if (!loop_dio_bio_set)
+		return -ENOMEM;
+	loop_dio_io_pool = mempool_create_kmalloc_pool(LOOP_DIO_MIN_IOS,
+						sizeof(struct loop_dio_io));
+	if (!loop_dio_io_pool) {
+		err = -ENOMEM;
+		goto bioset_out;
+	}
+
 	err = misc_register(&loop_misc);
 	if (err < 0)
-		return err;
+		goto pool_out;
 
 	part_shift = 0;
 	if (max_part > 0) {
@@ -1889,6 +2562,10 @@ static int __init loop_init(void)
 
 misc_out:
 	misc_deregister(&loop_misc);
+pool_out:
+	mempool_destroy(loop_dio_io_pool);
+bioset_out:
+	bioset_free(loop_dio_bio_set);
 	return err;
 }
 
@@ -1914,6 +2591,9 @@ static void __exit loop_exit(void)
 	unregister_blkdev(LOOP_MAJOR, "loop");
 
 	misc_deregister(&loop_misc);
+
+	mempool_destroy(loop_dio_io_pool);
+	bioset_free(loop_dio_bio_set);
 }
 
 module_init(loop_init);
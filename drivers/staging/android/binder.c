@@ -109,6 +109,17 @@ module_param_named(debug_mask, binder_debug_mask, uint, S_IWUSR | S_IRUGO);
 static bool binder_debug_no_lock;
 module_param_named(proc_no_lock, binder_debug_no_lock, bool, S_IWUSR | S_IRUGO);
 
+/*
+ * Number of freed buffer pages each proc keeps mapped in its binder area
+ * so that the next transaction touching them needs no alloc_page and
+ * map_vm_area.  The reserve is populated at mmap time and released under
+ * memory pressure by binder_shrinker.
+ */
+static unsigned int binder_reserve_pages = 8;
+module_param_named(reserve_pages, binder_reserve_pages, uint,
+		   S_IWUSR | S_IRUGO);
+static atomic_t binder_reserve_total = ATOMIC_INIT(0);
+
 static DECLARE_WAIT_QUEUE_HEAD(binder_user_error_wait);
 static int binder_stop_on_user_error;
 
@@ -277,6 +288,11 @@ struct binder_buffer {
 	uint8_t data[0];
 };
 
+struct binder_lru_page {
+	struct list_head lru; /* on proc->reserve while mapped but unused */
+	struct page *page_ptr;
+};
+
 enum binder_deferred_state {
 	BINDER_DEFERRED_PUT_FILES    = 0x01,
 	BINDER_DEFERRED_FLUSH        = 0x02,
@@ -304,7 +320,10 @@ struct binder_proc {
 	struct rb_root allocated_buffers;
 	size_t free_async_space;
 
-	struct page **pages;
+	struct binder_lru_page *pages;
+	struct list_head reserve;
+	int reserve_count;
+	int reserve_hits;
 	size_t buffer_size;
 	uint32_t buffer_free;
 	struct list_head todo;
@@ -566,7 +585,13 @@ static void binder_insert_free_buffer(struct binder_proc *proc,
 
 		buffer_size = binder_buffer_size(proc, buffer);
 
-		if (new_buffer_size < buffer_size)
+		/*
+		 * Equal sizes are kept in address order so that the
+		 * allocator hands out the lowest fitting buffer, keeping
+		 * the top of the area free for large parcels.
+		 */
+		if (new_buffer_size < buffer_size ||
+		    (new_buffer_size == buffer_size && new_buffer < buffer))
 			p = &parent->rb_left;
 		else
 			p = &parent->rb_right;
@@ -624,6 +649,27 @@ static struct binder_buffer *binder_buffer_lookup(struct binder_proc *proc,
 	return NULL;
 }
 
+static int binder_reserve_page(struct binder_proc *proc,
+			       struct binder_lru_page *page,
+			       struct vm_area_struct *vma)
+{
+	if (vma == NULL || proc->reserve_count >= binder_reserve_pages)
+		return 0;
+
+	list_add_tail(&page->lru, &proc->reserve);
+	proc->reserve_count++;
+	atomic_inc(&binder_reserve_total);
+	return 1;
+}
+
+static void binder_unreserve_page(struct binder_proc *proc,
+				  struct binder_lru_page *page)
+{
+	list_del_init(&page->lru);
+	proc->reserve_count--;
+	atomic_dec(&binder_reserve_total);
+}
+
 static int binder_update_page_range(struct binder_proc *proc, int allocate,
 				    void *start, void *end,
 				    struct vm_area_struct *vma)
@@ -631,7 +677,7 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 	void *page_addr;
 	unsigned long user_page_addr;
 	struct vm_struct tmp_area;
-	struct page **page;
+	struct binder_lru_page *page;
 	struct mm_struct *mm;
 
 	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
@@ -672,16 +718,22 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 		struct page **page_array_ptr;
 		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
 
-		BUG_ON(*page);
-		*page = alloc_page(GFP_KERNEL | __GFP_HIGHMEM | __GFP_ZERO);
-		if (*page == NULL) {
+		if (page->page_ptr) {
+			/* still mapped from the reserve */
+			BUG_ON(list_empty(&page->lru));
+			binder_unreserve_page(proc, page);
+			proc->reserve_hits++;
+			continue;
+		}
+		page->page_ptr = alloc_page(GFP_KERNEL | __GFP_HIGHMEM | __GFP_ZERO);
+		if (page->page_ptr == NULL) {
 			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
 			       "for page at %p\n", proc->pid, page_addr);
 			goto err_alloc_page_failed;
 		}
 		tmp_area.addr = page_addr;
 		tmp_area.size = PAGE_SIZE + PAGE_SIZE /* guard page? */;
-		page_array_ptr = page;
+		page_array_ptr = &page->page_ptr;
 		ret = map_vm_area(&tmp_area, PAGE_KERNEL, &page_array_ptr);
 		if (ret) {
 			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
@@ -691,7 +743,7 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 		}
 		user_page_addr =
 			(uintptr_t)page_addr + proc->user_buffer_offset;
-		ret = vm_insert_page(vma, user_page_addr, page[0]);
+		ret = vm_insert_page(vma, user_page_addr, page->page_ptr);
 		if (ret) {
 			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
 			       "to map page at %lx in userspace\n",
@@ -710,14 +762,16 @@ free_range:
 	for (page_addr = end - PAGE_SIZE; page_addr >= start;
 	     page_addr -= PAGE_SIZE) {
 		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
+		if (binder_reserve_page(proc, page, vma))
+			continue;
 		if (vma)
 			zap_page_range(vma, (uintptr_t)page_addr +
 				proc->user_buffer_offset, PAGE_SIZE, NULL);
 err_vm_insert_page_failed:
 		unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
 err_map_kernel_failed:
-		__free_page(*page);
-		*page = NULL;
+		__free_page(page->page_ptr);
+		page->page_ptr = NULL;
 err_alloc_page_failed:
 		;
 	}
@@ -769,25 +823,19 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 		BUG_ON(!buffer->free);
 		buffer_size = binder_buffer_size(proc, buffer);
 
-		if (size < buffer_size) {
+		if (size <= buffer_size) {
 			best_fit = n;
 			n = n->rb_left;
-		} else if (size > buffer_size)
+		} else
 			n = n->rb_right;
-		else {
-			best_fit = n;
-			break;
-		}
 	}
 	if (best_fit == NULL) {
 		printk(KERN_ERR "binder: %d: binder_alloc_buf size %zd failed, "
 		       "no address space\n", proc->pid, size);
 		return NULL;
 	}
-	if (n == NULL) {
-		buffer = rb_entry(best_fit, struct binder_buffer, rb_node);
-		buffer_size = binder_buffer_size(proc, buffer);
-	}
+	buffer = rb_entry(best_fit, struct binder_buffer, rb_node);
+	buffer_size = binder_buffer_size(proc, buffer);
 
 	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
 		     "binder: %d: binder_alloc_buf size %zd got buff"
@@ -795,12 +843,10 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 
 	has_page_addr =
 		(void *)(((uintptr_t)buffer->data + buffer_size) & PAGE_MASK);
-	if (n == NULL) {
-		if (size + sizeof(struct binder_buffer) + 4 >= buffer_size)
-			buffer_size = size; /* no room for other buffers */
-		else
-			buffer_size = size + sizeof(struct binder_buffer);
-	}
+	if (size + sizeof(struct binder_buffer) + 4 >= buffer_size)
+		buffer_size = size; /* no room for other buffers */
+	else
+		buffer_size = size + sizeof(struct binder_buffer);
 	end_page_addr =
 		(void *)PAGE_ALIGN((uintptr_t)buffer->data + buffer_size);
 	if (end_page_addr > has_page_addr)
@@ -2901,6 +2947,8 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 	struct binder_proc *proc = filp->private_data;
 	const char *failure_string;
 	struct binder_buffer *buffer;
+	size_t prefill;
+	int i;
 
 	if ((vma->vm_end - vma->vm_start) > SZ_4M)
 		vma->vm_end = vma->vm_start + SZ_4M;
@@ -2950,6 +2998,8 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 		goto err_alloc_pages_failed;
 	}
 	proc->buffer_size = vma->vm_end - vma->vm_start;
+	for (i = 0; i < proc->buffer_size / PAGE_SIZE; i++)
+		INIT_LIST_HEAD(&proc->pages[i].lru);
 
 	vma->vm_ops = &binder_vm_ops;
 	vma->vm_private_data = proc;
@@ -2965,6 +3015,19 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 	buffer->free = 1;
 	binder_insert_free_buffer(proc, buffer);
 	proc->free_async_space = proc->buffer_size / 2;
+
+	/*
+	 * Pre-populate the page reserve: map the pages right after the
+	 * first one and release them again, which parks them on
+	 * proc->reserve.  Failure just leaves the reserve empty.
+	 */
+	prefill = min_t(size_t, binder_reserve_pages,
+			proc->buffer_size / PAGE_SIZE - 1);
+	if (prefill && !binder_update_page_range(proc, 1,
+			proc->buffer + PAGE_SIZE,
+			proc->buffer + (prefill + 1) * PAGE_SIZE, vma))
+		binder_update_page_range(proc, 0, proc->buffer + PAGE_SIZE,
+			proc->buffer + (prefill + 1) * PAGE_SIZE, vma);
 	barrier();
 	proc->files = get_files_struct(proc->tsk);
 	proc->vma = vma;
@@ -3003,6 +3066,7 @@ static int binder_open(struct inode *nodp, struct file *filp)
 	get_task_struct(current);
 	proc->tsk = current;
 	INIT_LIST_HEAD(&proc->todo);
+	INIT_LIST_HEAD(&proc->reserve);
 	init_waitqueue_head(&proc->wait);
 	proc->default_priority = task_nice(current);
 
@@ -3160,17 +3224,22 @@ static void binder_deferred_release(struct binder_proc *proc)
 	if (proc->pages) {
 		int i;
 		for (i = 0; i < proc->buffer_size / PAGE_SIZE; i++) {
-			if (proc->pages[i]) {
+			if (proc->pages[i].page_ptr) {
 				void *page_addr = proc->buffer + i * PAGE_SIZE;
-				binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
-					     "binder_release: %d: "
-					     "page %d at %p not freed\n",
-					     proc->pid, i,
-					     page_addr);
+				if (!list_empty(&proc->pages[i].lru)) {
+					binder_unreserve_page(proc,
+							      &proc->pages[i]);
+				} else {
+					binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
+						     "binder_release: %d: "
+						     "page %d at %p not freed\n",
+						     proc->pid, i,
+						     page_addr);
+					page_count++;
+				}
 				unmap_kernel_range((unsigned long)page_addr,
 					PAGE_SIZE);
-				__free_page(proc->pages[i]);
-				page_count++;
+				__free_page(proc->pages[i].page_ptr);
 			}
 		}
 		kfree(proc->pages);
@@ -3539,6 +3608,8 @@ static void print_binder_proc_stats(struct seq_file *m,
 	for (n = rb_first(&proc->allocated_buffers); n != NULL; n = rb_next(n))
 		count++;
 	seq_printf(m, "  buffers: %d\n", count);
+	seq_printf(m, "  reserve pages: %d hits %d\n",
+		   proc->reserve_count, proc->reserve_hits);
 
 	count = 0;
 	list_for_each_entry(w, &proc->todo, entry) {
@@ -3677,6 +3748,78 @@ BINDER_DEBUG_ENTRY(stats);
 BINDER_DEBUG_ENTRY(transactions);
 BINDER_DEBUG_ENTRY(transaction_log);
 
+static int binder_shrink_reserve(struct binder_proc *proc,
+				 unsigned long nr_to_scan)
+{
+	struct mm_struct *mm;
+	struct vm_area_struct *vma;
+	struct binder_lru_page *page;
+	void *page_addr;
+	int freed = 0;
+
+	mm = get_task_mm(proc->tsk);
+	if (mm == NULL)
+		return 0;
+	if (!down_write_trylock(&mm->mmap_sem))
+		goto out_mmput;
+
+	vma = proc->vma;
+	if (vma == NULL || mm != proc->vma_vm_mm)
+		goto out_unlock;
+
+	while (freed < nr_to_scan && !list_empty(&proc->reserve)) {
+		page = list_first_entry(&proc->reserve,
+					struct binder_lru_page, lru);
+		binder_unreserve_page(proc, page);
+		page_addr = proc->buffer + (page - proc->pages) * PAGE_SIZE;
+		zap_page_range(vma, (uintptr_t)page_addr +
+			proc->user_buffer_offset, PAGE_SIZE, NULL);
+		unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
+		__free_page(page->page_ptr);
+		page->page_ptr = NULL;
+		freed++;
+	}
+
+out_unlock:
+	up_write(&mm->mmap_sem);
+out_mmput:
+	mmput(mm);
+	return freed;
+}
+
+static int binder_shrink(struct shrinker *s, struct shrink_control *sc)
+{
+	struct binder_proc *proc;
+	struct hlist_node *pos;
+	unsigned long nr_to_scan = sc->nr_to_scan;
+
+	if (nr_to_scan == 0)
+		return atomic_read(&binder_reserve_total);
+
+	/*
+	 * Binder allocates with binder_main_lock held, so never wait for
+	 * it from reclaim; the reserve is simply trimmed on a later pass.
+	 */
+	if (!mutex_trylock(&binder_main_lock))
+		return -1;
+
+	hlist_for_each_entry(proc, pos, &binder_procs, proc_node) {
+		if (nr_to_scan == 0)
+			break;
+		if (proc->reserve_count == 0)
+			continue;
+		nr_to_scan -= binder_shrink_reserve(proc, nr_to_scan);
+	}
+	mutex_unlock(&binder_main_lock);
+
+	return atomic_read(&binder_reserve_total);
+}
+
+static struct shrinker binder_shrinker = {
+	.shrink = binder_shrink,
+	.seeks = DEFAULT_SEEKS * 4,
+};
+
 static int __init binder_init(void)
 {
 	int ret;
@@ -3690,6 +3833,8 @@ static int __init binder_init(void)
 		binder_debugfs_dir_entry_proc = debugfs_create_dir("proc",
 						 binder_debugfs_dir_entry_root);
 	ret = misc_register(&binder_miscdev);
+	if (!ret)
+		register_shrinker(&binder_shrinker);
 	if (binder_debugfs_dir_entry_root) {
 		debugfs_create_file("state",
 				    S_IRUGO,
@@ -28,6 +28,9 @@
 
 #include <linux/types.h>
 #include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/pagemap.h>
+#include <linux/scatterlist.h>
 #include <linux/device.h>
 #include <linux/miscdevice.h>
 
@@ -37,6 +40,8 @@
 #include <linux/usb/f_mtp.h>
 
 #define MTP_BULK_BUFFER_SIZE       16384
+#define MTP_TX_BUFFER_INIT_SIZE    131072
+#define MTP_RX_BUFFER_INIT_SIZE    131072
 #define INTR_BUFFER_SIZE           28
 
 /* String IDs */
@@ -50,8 +55,10 @@
 #define STATE_ERROR                 4   /* error from completion routine */
 
 /* number of tx and rx requests to allocate */
-#define TX_REQ_MAX 4
-#define RX_REQ_MAX 2
+#define TX_REQ_MAX 16
+#define RX_REQ_MAX 16
+#define TX_REQ_DEFAULT 4
+#define RX_REQ_DEFAULT 4
 #define INTR_REQ_MAX 5
 
 /* ID for Microsoft MTP OS String */
@@ -67,11 +74,38 @@
 #define MTP_RESPONSE_OK             0x2001
 #define MTP_RESPONSE_DEVICE_BUSY    0x2019
 
-unsigned int mtp_rx_req_len = MTP_BULK_BUFFER_SIZE;
+/*
+ * Size and number of the bulk requests used for file transfers.  They
+ * are picked up when the function is bound; if the buffers cannot be
+ * allocated we fall back to MTP_BULK_BUFFER_SIZE.
+ */
+unsigned int mtp_rx_req_len = MTP_RX_BUFFER_INIT_SIZE;
 module_param(mtp_rx_req_len, uint, S_IRUGO | S_IWUSR);
 
+static unsigned int mtp_tx_req_len = MTP_TX_BUFFER_INIT_SIZE;
+module_param(mtp_tx_req_len, uint, S_IRUGO | S_IWUSR);
+
+static unsigned int mtp_rx_reqs = RX_REQ_DEFAULT;
+module_param(mtp_rx_reqs, uint, S_IRUGO | S_IWUSR);
+
+static unsigned int mtp_tx_reqs = TX_REQ_DEFAULT;
+module_param(mtp_tx_reqs, uint, S_IRUGO | S_IWUSR);
+
 static const char mtp_shortname[] = "mtp_usb";
 
+/*
+ * State hung off req->context of the tx requests when the controller can
+ * do scatter-gather, so send_file_work() can hand it page cache pages
+ * instead of copying the file into req->buf.
+ */
+struct mtp_tx_ctx {
+	void *buf;		/* the request's own buffer */
+	int max_pages;
+	int nr_pages;		/* page references held by the request */
+	struct page **pages;
+	struct scatterlist *sg;
+};
+
 struct mtp_dev {
 	struct usb_function function;
 	struct usb_composite_dev *cdev;
@@ -95,8 +129,15 @@ struct mtp_dev {
 	wait_queue_head_t write_wq;
 	wait_queue_head_t intr_wq;
 	struct usb_request *rx_req[RX_REQ_MAX];
+	/* rx requests completed but not yet consumed */
 	int rx_done;
 
+	/* bulk request sizes and counts, fixed at bind time */
+	unsigned tx_req_len;
+	unsigned rx_req_len;
+	int tx_reqs;
+	int rx_reqs;
+
 	/* for processing MTP_SEND_FILE, MTP_RECEIVE_FILE and
 	 * MTP_SEND_FILE_WITH_HEADER ioctls on a work queue
 	 */
@@ -296,9 +337,45 @@ static struct usb_request *mtp_request_new(struct usb_ep *ep, int buffer_size)
 	return req;
 }
 
+static int mtp_tx_ctx_alloc(struct usb_request *req, unsigned len)
+{
+	struct mtp_tx_ctx *ctx;
+	/* one more page for an unaligned offset, one more sg for the header */
+	int max_pages = DIV_ROUND_UP(len, PAGE_CACHE_SIZE) + 1;
+
+	ctx = kzalloc(sizeof(*ctx) + max_pages * sizeof(struct page *) +
+		      (max_pages + 1) * sizeof(struct scatterlist), GFP_KERNEL);
+	if (!ctx)
+		return -ENOMEM;
+	ctx->buf = req->buf;
+	ctx->max_pages = max_pages;
+	ctx->pages = (struct page **)(ctx + 1);
+	ctx->sg = (struct scatterlist *)(ctx->pages + max_pages);
+	req->context = ctx;
+	return 0;
+}
+
+/* drop the page cache pages attached to a tx request, if any */
+static void mtp_tx_put_pages(struct usb_request *req)
+{
+	struct mtp_tx_ctx *ctx = req->context;
+
+	if (!ctx)
+		return;
+	while (ctx->nr_pages)
+		page_cache_release(ctx->pages[--ctx->nr_pages]);
+	req->buf = ctx->buf;
+	req->sg = NULL;
+	req->num_sgs = 0;
+}
+
 static void mtp_request_free(struct usb_request *req, struct usb_ep *ep)
 {
 	if (req) {
+		if (req->context) {
+			mtp_tx_put_pages(req);
+			kfree(req->context);
+		}
 		kfree(req->buf);
 		usb_ep_free_request(ep, req);
 	}
@@ -355,6 +432,7 @@ static void mtp_complete_in(struct usb_ep *ep, struct usb_request *req)
 	if (req->status != 0)
 		dev->state = STATE_ERROR;
 
+	mtp_tx_put_pages(req);
 	mtp_req_put(dev, &dev->tx_idle, req);
 
 	wake_up(&dev->write_wq);
@@ -363,10 +441,15 @@ static void mtp_complete_in(struct usb_ep *ep, struct usb_request *req)
 static void mtp_complete_out(struct usb_ep *ep, struct usb_request *req)
 {
 	struct mtp_dev *dev = _mtp_dev;
+	unsigned long flags;
 
-	dev->rx_done = 1;
-	if (req->status != 0)
+	/* rx requests complete in the order they were queued */
+	spin_lock_irqsave(&dev->lock, flags);
+	dev->rx_done++;
+	/* -ECONNRESET is us dequeueing it, the caller knows why */
+	if (req->status != 0 && req->status != -ECONNRESET)
 		dev->state = STATE_ERROR;
+	spin_unlock_irqrestore(&dev->lock, flags);
 
 	wake_up(&dev->read_wq);
 }
@@ -422,23 +505,44 @@ static int mtp_create_bulk_endpoints(struct mtp_dev *dev,
 	ep->driver_data = dev;		/* claim the endpoint */
 	dev->ep_intr = ep;
 
-	/* now allocate requests for our endpoints */
-	for (i = 0; i < TX_REQ_MAX; i++) {
-		req = mtp_request_new(dev->ep_in, MTP_BULK_BUFFER_SIZE);
-		if (!req)
-			goto fail;
+	/*
+	 * Now allocate requests for our endpoints.  Bulk request lengths
+	 * are kept page multiples so that every request but the last one
+	 * of a transfer ends on a packet boundary.
+	 */
+	dev->tx_req_len = round_down(max_t(unsigned, mtp_tx_req_len,
+				MTP_BULK_BUFFER_SIZE), PAGE_SIZE);
+	dev->tx_reqs = clamp_t(unsigned, mtp_tx_reqs, 1, TX_REQ_MAX);
+retry_tx_alloc:
+	for (i = 0; i < dev->tx_reqs; i++) {
+		req = mtp_request_new(dev->ep_in, dev->tx_req_len);
+		if (!req) {
+			if (dev->tx_req_len <= MTP_BULK_BUFFER_SIZE)
+				goto fail;
+			while ((req = mtp_req_get(dev, &dev->tx_idle)))
+				mtp_request_free(req, dev->ep_in);
+			dev->tx_req_len = MTP_BULK_BUFFER_SIZE;
+			goto retry_tx_alloc;
+		}
+		/* without it we just copy through req->buf */
+		if (cdev->gadget->sg_supported)
+			mtp_tx_ctx_alloc(req, dev->tx_req_len);
 		req->complete = mtp_complete_in;
 		mtp_req_put(dev, &dev->tx_idle, req);
 	}
+
+	dev->rx_req_len = round_down(max_t(unsigned, mtp_rx_req_len,
+				MTP_BULK_BUFFER_SIZE), PAGE_SIZE);
+	dev->rx_reqs = clamp_t(unsigned, mtp_rx_reqs, 2, RX_REQ_MAX);
 retry_rx_alloc:
-	for (i = 0; i < RX_REQ_MAX; i++) {
-		req = mtp_request_new(dev->ep_out, mtp_rx_req_len);
+	for (i = 0; i < dev->rx_reqs; i++) {
+		req = mtp_request_new(dev->ep_out, dev->rx_req_len);
 		if (!req) {
-			if (mtp_rx_req_len <= MTP_BULK_BUFFER_SIZE)
+			if (dev->rx_req_len <= MTP_BULK_BUFFER_SIZE)
 				goto fail;
-			for (; i > 0; i--)
+			while (--i >= 0)
 				mtp_request_free(dev->rx_req[i], dev->ep_out);
-			mtp_rx_req_len = MTP_BULK_BUFFER_SIZE;
+			dev->rx_req_len = MTP_BULK_BUFFER_SIZE;
 			goto retry_rx_alloc;
 		}
 		req->complete = mtp_complete_out;
@@ -470,7 +574,7 @@ static ssize_t mtp_read(struct file *fp, char __user *buf,
 
 	DBG(cdev, "mtp_read(%d)\n", count);
 
-	if (count > mtp_rx_req_len)
+	if (count > dev->rx_req_len)
 		return -EINVAL;
 
 	/* we will block until we're online */
@@ -599,8 +703,8 @@ static ssize_t mtp_write(struct file *fp, const char __user *buf,
 			break;
 		}
 
-		if (count > MTP_BULK_BUFFER_SIZE)
-			xfer = MTP_BULK_BUFFER_SIZE;
+		if (count > dev->tx_req_len)
+			xfer = dev->tx_req_len;
 		else
 			xfer = count;
 		if (xfer && copy_from_user(req->buf, buf, xfer)) {
@@ -637,6 +741,79 @@ static ssize_t mtp_write(struct file *fp, const char __user *buf,
 	return r;
 }
 
+/*
+ * Point a tx request at the page cache pages holding the @len bytes of
+ * @filp at *@offset, after the @hdr_size bytes of header already in its
+ * buffer, so the data goes out without being copied.  All or nothing:
+ * returns @len and advances *@offset, or a negative error when the caller
+ * should fall back to vfs_read().
+ */
+static int mtp_send_pages(struct usb_request *req, struct file *filp,
+		loff_t *offset, int hdr_size, int len)
+{
+	struct mtp_tx_ctx *ctx = req->context;
+	struct address_space *mapping = filp->f_mapping;
+	loff_t pos = *offset;
+	pgoff_t index, last_index;
+	int done = 0, nsg = 0;
+
+	if (!mapping->a_ops->readpage ||
+			pos + len > i_size_read(mapping->host))
+		return -EINVAL;
+
+	index = pos >> PAGE_CACHE_SHIFT;
+	last_index = (pos + len - 1) >> PAGE_CACHE_SHIFT;
+	if (last_index - index + 1 > ctx->max_pages)
+		return -EINVAL;
+
+	sg_init_table(ctx->sg, ctx->max_pages + 1);
+	if (hdr_size)
+		sg_set_buf(&ctx->sg[nsg++], ctx->buf, hdr_size);
+
+	while (done < len) {
+		unsigned off = pos & ~PAGE_CACHE_MASK;
+		unsigned bytes = min_t(unsigned, PAGE_CACHE_SIZE - off,
+				       len - done);
+		struct page *page;
+
+		page = find_get_page(mapping, index);
+		if (!page) {
+			page_cache_sync_readahead(mapping, &filp->f_ra, filp,
+					index, last_index - index + 1);
+			page = find_get_page(mapping, index);
+			if (!page)
+				goto fallback;
+		}
+		if (PageReadahead(page))
+			page_cache_async_readahead(mapping, &filp->f_ra, filp,
+					page, index, last_index - index + 1);
+		if (!PageUptodate(page)) {
+			if (wait_on_page_locked_killable(page) ||
+					!PageUptodate(page)) {
+				page_cache_release(page);
+				goto fallback;
+			}
+		}
+
+		ctx->pages[ctx->nr_pages++] = page;
+		sg_set_page(&ctx->sg[nsg++], page, bytes, off);
+		done += bytes;
+		pos += bytes;
+		index++;
+	}
+
+	sg_mark_end(&ctx->sg[nsg - 1]);
+	req->buf = NULL;
+	req->sg = ctx->sg;
+	req->num_sgs = nsg;
+	*offset = pos;
+	return len;
+
+fallback:
+	mtp_tx_put_pages(req);
+	return -EAGAIN;
+}
+
 /* read from a local file and write to USB */
 static void send_file_work(struct work_struct *data)
 {
@@ -692,8 +869,8 @@ static void send_file_work(struct work_struct *data)
 			break;
 		}
 
-		if (count > MTP_BULK_BUFFER_SIZE)
-			xfer = MTP_BULK_BUFFER_SIZE;
+		if (count > dev->tx_req_len)
+			xfer = dev->tx_req_len;
 		else
 			xfer = count;
 
@@ -707,8 +884,13 @@ static void send_file_work(struct work_struct *data)
 					__cpu_to_le32(dev->xfer_transaction_id);
 		}
 
-		ret = vfs_read(filp, req->buf + hdr_size, xfer - hdr_size,
-								&offset);
+		ret = -EINVAL;
+		if (req->context && xfer > hdr_size)
+			ret = mtp_send_pages(req, filp, &offset, hdr_size,
+					     xfer - hdr_size);
+		if (ret < 0)
+			ret = vfs_read(filp, req->buf + hdr_size,
+				       xfer - hdr_size, &offset);
 		if (ret < 0) {
 			r = ret;
 			break;
@@ -720,6 +902,7 @@ static void send_file_work(struct work_struct *data)
 		ret = usb_ep_queue(dev->ep_in, req, GFP_KERNEL);
 		if (ret < 0) {
 			DBG(cdev, "send_file_work: xfer error %d\n", ret);
+			mtp_tx_put_pages(req);
 			if (dev->state != STATE_OFFLINE)
 				dev->state = STATE_ERROR;
 			r = -EIO;
@@ -735,6 +918,9 @@ static void send_file_work(struct work_struct *data)
 	if (req)
 		mtp_req_put(dev, &dev->tx_idle, req);
 
+	/* vfs_read() does this for the copy path */
+	file_accessed(filp);
+
 	DBG(cdev, "send_file_work returning %d\n", r);
 	/* write the result */
 	dev->xfer_result = r;
@@ -747,11 +933,11 @@ static void receive_file_work(struct work_struct *data)
 	struct mtp_dev *dev = container_of(data, struct mtp_dev,
 						receive_file_work);
 	struct usb_composite_dev *cdev = dev->cdev;
-	struct usb_request *read_req = NULL, *write_req = NULL;
+	struct usb_request *req;
 	struct file *filp;
 	loff_t offset;
 	int64_t count;
-	int ret, cur_buf = 0;
+	int ret, head = 0, tail = 0, queued = 0, depth;
 	int r = 0;
 
 	/* read our parameters */
@@ -762,68 +948,86 @@ static void receive_file_work(struct work_struct *data)
 
 	DBG(cdev, "receive_file_work(%lld)\n", count);
 
-	while (count > 0 || write_req) {
-		if (count > 0) {
-			/* queue a request */
-			read_req = dev->rx_req[cur_buf];
-			cur_buf = (cur_buf + 1) % RX_REQ_MAX;
+	/*
+	 * Keep several reads queued so the host can go on sending while we
+	 * write out the oldest one.  If xfer_file_length is 0xFFFFFFFF we
+	 * read until we get a short packet and don't know where the next
+	 * transaction starts, so only keep one read queued then.
+	 */
+	depth = (count == 0xFFFFFFFF) ? 1 : dev->rx_reqs;
+	dev->rx_done = 0;
 
-			read_req->length = (count > mtp_rx_req_len
-					? mtp_rx_req_len : count);
-			dev->rx_done = 0;
-			ret = usb_ep_queue(dev->ep_out, read_req, GFP_KERNEL);
+	while (count > 0 || queued) {
+		/* count is what we have yet to queue reads for */
+		while (count > 0 && queued < depth) {
+			req = dev->rx_req[head];
+			req->length = (count > dev->rx_req_len
+					? dev->rx_req_len : count);
+			ret = usb_ep_queue(dev->ep_out, req, GFP_KERNEL);
 			if (ret < 0) {
 				r = -EIO;
 				if (dev->state != STATE_OFFLINE)
 					dev->state = STATE_ERROR;
-				break;
+				goto out;
 			}
+			head = (head + 1) % dev->rx_reqs;
+			queued++;
+			if (count != 0xFFFFFFFF)
+				count -= req->length;
 		}
 
-		if (write_req) {
-			DBG(cdev, "rx %p %d\n", write_req, write_req->actual);
-			ret = vfs_write(filp, write_req->buf, write_req->actual,
-				&offset);
-			DBG(cdev, "vfs_write %d\n", ret);
-			if (ret != write_req->actual) {
-				r = -EIO;
-				if (dev->state != STATE_OFFLINE)
-					dev->state = STATE_ERROR;
-				break;
-			}
-			write_req = NULL;
+		/* wait for the oldest read to complete */
+		req = dev->rx_req[tail];
+		ret = wait_event_interruptible(dev->read_wq,
+			dev->rx_done || dev->state != STATE_BUSY);
+		if (dev->state == STATE_CANCELED
+				|| dev->state == STATE_OFFLINE) {
+			r = -ECANCELED;
+			goto out;
+		}
+		if (ret < 0 || dev->state != STATE_BUSY) {
+			r = -EIO;
+			goto out;
 		}
 
-		if (read_req) {
-			/* wait for our last read to complete */
-			ret = wait_event_interruptible(dev->read_wq,
-				dev->rx_done || dev->state != STATE_BUSY);
-			if (dev->state == STATE_CANCELED
-					|| dev->state == STATE_OFFLINE) {
-				r = -ECANCELED;
-				if (!dev->rx_done)
-					usb_ep_dequeue(dev->ep_out, read_req);
-				break;
-			}
-			/* if xfer_file_length is 0xFFFFFFFF, then we read until
-			 * we get a zero length packet
+		spin_lock_irq(&dev->lock);
+		dev->rx_done--;
+		spin_unlock_irq(&dev->lock);
+		tail = (tail + 1) % dev->rx_reqs;
+		queued--;
+
+		if (req->actual < req->length) {
+			/*
+			 * short packet is used to signal EOF for
+			 * sizes > 4 gig
 			 */
-			if (count != 0xFFFFFFFF)
-				count -= read_req->actual;
-			if (read_req->actual < read_req->length) {
-				/*
-				 * short packet is used to signal EOF for
-				 * sizes > 4 gig
-				 */
-				DBG(cdev, "got short packet\n");
-				count = 0;
-			}
+			DBG(cdev, "got short packet\n");
+			count = 0;
+		}
 
-			write_req = read_req;
-			read_req = NULL;
+		DBG(cdev, "rx %p %d\n", req, req->actual);
+		ret = vfs_write(filp, req->buf, req->actual, &offset);
+		DBG(cdev, "vfs_write %d\n", ret);
+		if (ret != req->actual) {
+			r = -EIO;
+			if (dev->state != STATE_OFFLINE)
+				dev->state = STATE_ERROR;
+			goto out;
 		}
+
+		/* anything still queued after a short packet isn't ours */
+		if (count == 0 && queued)
+			goto out;
 	}
 
+out:
+	/* take back the reads still queued and wait for them to complete */
+	for (ret = 0; ret < queued; ret++)
+		usb_ep_dequeue(dev->ep_out,
+			       dev->rx_req[(tail + ret) % dev->rx_reqs]);
+	wait_event(dev->read_wq, dev->rx_done >= queued);
+	dev->rx_done = 0;
+
 	DBG(cdev, "receive_file_work returning %d\n", r);
 	/* write the result */
 	dev->xfer_result = r;
@@ -1140,7 +1344,7 @@ mtp_function_unbind(struct usb_configuration *c, struct usb_function *f)
 
 	while ((req = mtp_req_get(dev, &dev->tx_idle)))
 		mtp_request_free(req, dev->ep_in);
-	for (i = 0; i < RX_REQ_MAX; i++)
+	for (i = 0; i < dev->rx_reqs; i++)
 		mtp_request_free(dev->rx_req[i], dev->ep_out);
 	while ((req = mtp_req_get(dev, &dev->intr_idle)))
 		mtp_request_free(req, dev->ep_intr);
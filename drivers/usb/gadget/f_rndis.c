@@ -30,6 +30,13 @@ module_param(rndis_multipacket_dl_disable, bool, S_IRUGO|S_IWUSR);
 MODULE_PARM_DESC(rndis_multipacket_dl_disable,
 	"Disable RNDIS Multi-packet support in DownLink");
 
+#define RNDIS_UL_MAX_PKT_PER_XFER_LIMIT	16
+
+static unsigned int rndis_ul_max_pkt_per_xfer = 3;
+module_param(rndis_ul_max_pkt_per_xfer, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(rndis_ul_max_pkt_per_xfer,
+	"Maximum packets per transfer for UpLink (host to device)");
+
 /*
  * This function is an RNDIS Ethernet port -- a Microsoft protocol that's
  * been promoted instead of the standard CDC Ethernet.  The published RNDIS
@@ -800,6 +807,13 @@ rndis_bind(struct usb_configuration *c, struct usb_function *f)
 	rndis_set_param_medium(rndis->config, NDIS_MEDIUM_802_3, 0);
 	rndis_set_host_mac(rndis->config, rndis->ethaddr);
 
+	/* let the host aggregate uplink packets, rndis_rm_hdr splits them */
+	rndis->port.ul_max_pkts_per_xfer = clamp_t(unsigned,
+			rndis_ul_max_pkt_per_xfer, 1,
+			RNDIS_UL_MAX_PKT_PER_XFER_LIMIT);
+	rndis_set_max_pkt_xfer(rndis->config,
+			rndis->port.ul_max_pkts_per_xfer);
+
 	if (rndis->manufacturer && rndis->vendorID &&
 			rndis_set_param_vendor(rndis->config, rndis->vendorID,
 					       rndis->manufacturer))
@@ -586,10 +586,10 @@ static int rndis_init_response(int configNr, rndis_init_msg_type *buf)
 	resp->DeviceFlags = cpu_to_le32(RNDIS_DF_CONNECTIONLESS);
 	resp->Medium = cpu_to_le32(RNDIS_MEDIUM_802_3);
 	resp->MaxPacketsPerTransfer = cpu_to_le32(params->max_pkt_per_xfer);
-	resp->MaxTransferSize = cpu_to_le32(
-		  params->dev->mtu
+	resp->MaxTransferSize = cpu_to_le32(params->max_pkt_per_xfer *
+		(params->dev->mtu
 		+ sizeof(struct ethhdr)
-		+ sizeof(struct rndis_packet_msg_type)
+		+ sizeof(struct rndis_packet_msg_type))
 		+ 22);
 	resp->PacketAlignmentFactor = cpu_to_le32(0);
 	resp->AFListOffset = cpu_to_le32(0);
@@ -1031,30 +1031,56 @@ static rndis_resp_t *rndis_add_response(int configNr, u32 length)
 	return r;
 }
 
+/*
+ * The host may pack up to MaxPacketsPerTransfer packet messages into one
+ * transfer.  All but the last are queued as clones sharing the transfer's
+ * buffer; the last one (usually the only one) keeps the original skb.
+ */
 int rndis_rm_hdr(struct gether *port,
 			struct sk_buff *skb,
 			struct sk_buff_head *list)
 {
-	/* tmp points to a struct rndis_packet_msg_type */
-	__le32 *tmp = (void *)skb->data;
+	for (;;) {
+		struct rndis_packet_msg_type *hdr = (void *)skb->data;
+		struct sk_buff *skb2;
+		u32 msg_len, data_offset, data_len;
+
+		if (skb->len < sizeof(*hdr) ||
+				cpu_to_le32(REMOTE_NDIS_PACKET_MSG)
+				!= get_unaligned(&hdr->MessageType)) {
+			dev_kfree_skb_any(skb);
+			return -EINVAL;
+		}
+		msg_len = get_unaligned_le32(&hdr->MessageLength);
+		data_offset = get_unaligned_le32(&hdr->DataOffset) + 8;
+		data_len = get_unaligned_le32(&hdr->DataLength);
+
+		if (data_offset > skb->len ||
+				data_len > skb->len - data_offset) {
+			dev_kfree_skb_any(skb);
+			return -EOVERFLOW;
+		}
 
-	/* MessageType, MessageLength */
-	if (cpu_to_le32(REMOTE_NDIS_PACKET_MSG)
-			!= get_unaligned(tmp++)) {
-		dev_kfree_skb_any(skb);
-		return -EINVAL;
-	}
-	tmp++;
+		/* last message, possibly followed by a pad byte */
+		if (msg_len < data_offset + data_len || msg_len >= skb->len ||
+				skb->len - msg_len < sizeof(*hdr)) {
+			skb_pull(skb, data_offset);
+			skb_trim(skb, data_len);
+			skb_queue_tail(list, skb);
+			return 0;
+		}
 
-	/* DataOffset, DataLength */
-	if (!skb_pull(skb, get_unaligned_le32(tmp++) + 8)) {
-		dev_kfree_skb_any(skb);
-		return -EOVERFLOW;
-	}
-	skb_trim(skb, get_unaligned_le32(tmp++));
+		skb2 = skb_clone(skb, GFP_ATOMIC);
+		if (!skb2) {
+			dev_kfree_skb_any(skb);
+			return -ENOMEM;
+		}
+		skb_pull(skb2, data_offset);
+		skb_trim(skb2, data_len);
+		skb_queue_tail(list, skb2);
 
-	skb_queue_tail(list, skb);
-	return 0;
+		skb_pull(skb, msg_len);
+	}
 }
 
 #ifdef CONFIG_USB_GADGET_DEBUG_FILES
@@ -46,8 +46,6 @@
 
 #define UETH__VERSION	"29-May-2008"
 
-static struct workqueue_struct	*uether_wq;
-
 struct eth_dev {
 	/* lock is held while accessing port_usb
 	 * or updating its backlink port_usb->ioport
@@ -60,6 +58,7 @@ struct eth_dev {
 
 	spinlock_t		req_lock;	/* guard {rx,tx}_reqs */
 	struct list_head	tx_reqs, rx_reqs;
+	spinlock_t		bql_lock;	/* guard byte queue limits */
 	unsigned		tx_qlen;
 /* Minimum number of TX USB request queued to UDC */
 #define TX_REQ_THRESHOLD	5
@@ -68,6 +67,10 @@ struct eth_dev {
 	u32			tx_req_bufsize;
 
 	struct sk_buff_head	rx_frames;
+	/* empty rx buffers the stack never saw, for rx_submit() to reuse */
+	struct sk_buff_head	rx_recycle;
+	unsigned		rx_buf_size;
+	struct napi_struct	napi;
 
 	unsigned		header_len;
 	struct sk_buff		*(*wrap)(struct gether *, struct sk_buff *skb);
@@ -76,7 +79,6 @@ struct eth_dev {
 						struct sk_buff_head *list);
 
 	struct work_struct	work;
-	struct work_struct	rx_work;
 
 	unsigned long		todo;
 #define	WORK_RX_MEMORY		0
@@ -91,6 +93,8 @@ struct eth_dev {
 
 #define DEFAULT_QLEN	2	/* double buffering by default */
 
+#define GETHER_NAPI_WEIGHT	64
+
 #ifdef CONFIG_USB_GADGET_DUALSPEED
 
 static unsigned qmult = 10;
@@ -237,23 +241,36 @@ rx_submit(struct eth_dev *dev, struct usb_request *req, gfp_t gfp_flags)
 	 */
 	size += sizeof(struct ethhdr) + dev->net->mtu + RX_EXTRA;
 	size += dev->port_usb->header_len;
+	/* room for as many packets as the host may pack into a transfer */
+	if (dev->port_usb->ul_max_pkts_per_xfer > 1)
+		size *= dev->port_usb->ul_max_pkts_per_xfer;
 	size += out->maxpacket - 1;
 	size -= size % out->maxpacket;
 
 	if (dev->port_usb->is_fixed)
 		size = max_t(size_t, size, dev->port_usb->fixed_out_len);
+	dev->rx_buf_size = size;
 
-	skb = alloc_skb(size + NET_IP_ALIGN, gfp_flags);
-	if (skb == NULL) {
-		DBG(dev, "no rx skb\n");
-		goto enomem;
+	skb = skb_dequeue(&dev->rx_recycle);
+	if (skb && skb_tailroom(skb) < size) {
+		dev_kfree_skb_any(skb);
+		skb = NULL;
 	}
+	if (!skb) {
+		skb = __netdev_alloc_skb(dev->net, size + NET_IP_ALIGN,
+					 gfp_flags);
+		if (skb == NULL) {
+			DBG(dev, "no rx skb\n");
+			goto enomem;
+		}
 
-	/* Some platforms perform better when IP packets are aligned,
-	 * but on at least one, checksumming fails otherwise.  Note:
-	 * RNDIS headers involve variable numbers of LE32 values.
-	 */
-	skb_reserve(skb, NET_IP_ALIGN);
+		/* Some platforms perform better when IP packets are
+		 * aligned, but on at least one, checksumming fails
+		 * otherwise.  Note: RNDIS headers involve variable
+		 * numbers of LE32 values.
+		 */
+		skb_reserve(skb, NET_IP_ALIGN);
+	}
 
 	req->buf = skb->data;
 	req->length = size;
@@ -272,6 +289,18 @@ enomem:
 	return retval;
 }
 
+/*
+ * Keep an empty rx buffer, with NET_IP_ALIGN already reserved, for the
+ * next rx_submit() instead of freeing it.
+ */
+static void rx_recycle(struct eth_dev *dev, struct sk_buff *skb)
+{
+	if (skb_queue_len(&dev->rx_recycle) < qlen(dev->gadget))
+		skb_queue_tail(&dev->rx_recycle, skb);
+	else
+		dev_kfree_skb_any(skb);
+}
+
 static void rx_complete(struct usb_ep *ep, struct usb_request *req)
 {
 	struct sk_buff	*skb = req->context;
@@ -306,8 +335,8 @@ static void rx_complete(struct usb_ep *ep, struct usb_request *req)
 			skb_queue_tail(&dev->rx_frames, skb);
 		}
 
-		if (!status)
-			queue = 1;
+		/* unwrap may have queued frames before failing */
+		queue = 1;
 		break;
 
 	/* software-driven interface shutdown */
@@ -331,7 +360,8 @@ quiesce:
 
 	default:
 		queue = 1;
-		dev_kfree_skb_any(skb);
+		/* nothing was put in the buffer, use it again */
+		rx_recycle(dev, skb);
 		dev->net->stats.rx_errors++;
 		DBG(dev, "rx status %d\n", status);
 		break;
@@ -343,7 +373,7 @@ clean:
 	spin_unlock(&dev->req_lock);
 
 	if (queue)
-		queue_work(uether_wq, &dev->rx_work);
+		napi_schedule(&dev->napi);
 }
 
 static int prealloc(struct list_head *list, struct usb_ep *ep, unsigned n)
@@ -435,34 +465,59 @@ static void rx_fill(struct eth_dev *dev, gfp_t gfp_flags)
 	spin_unlock_irqrestore(&dev->req_lock, flags);
 }
 
-static void process_rx_w(struct work_struct *work)
+static int eth_poll(struct napi_struct *napi, int budget)
 {
-	struct eth_dev	*dev = container_of(work, struct eth_dev, rx_work);
+	struct eth_dev	*dev = container_of(napi, struct eth_dev, napi);
 	struct sk_buff	*skb;
-	int		status = 0;
+	int		work_done = 0;
 
-	if (!dev->port_usb)
-		return;
-
-	while ((skb = skb_dequeue(&dev->rx_frames))) {
-		if (status < 0
-				|| ETH_HLEN > skb->len
-				|| skb->len > ETH_FRAME_LEN) {
+	while (work_done < budget &&
+			(skb = skb_dequeue(&dev->rx_frames))) {
+		if (ETH_HLEN > skb->len || skb->len > ETH_FRAME_LEN) {
 			dev->net->stats.rx_errors++;
 			dev->net->stats.rx_length_errors++;
 			DBG(dev, "rx length %d\n", skb->len);
-			dev_kfree_skb_any(skb);
+			if (skb_recycle_check(skb,
+					dev->rx_buf_size + NET_IP_ALIGN)) {
+				skb_reserve(skb, NET_IP_ALIGN);
+				rx_recycle(dev, skb);
+			} else {
+				dev_kfree_skb_any(skb);
+			}
 			continue;
 		}
 		skb->protocol = eth_type_trans(skb, dev->net);
+
+		/*
+		 * GRO only merges TCP segments whose checksum has been
+		 * checked, and USB gives us no help with that.  The stack
+		 * would checksum these anyway, so do it here instead.
+		 */
+		if ((dev->net->features & NETIF_F_GRO) &&
+				(skb->protocol == htons(ETH_P_IP) ||
+				 skb->protocol == htons(ETH_P_IPV6))) {
+			skb->csum = csum_partial(skb->data, skb->len, 0);
+			skb->ip_summed = CHECKSUM_COMPLETE;
+		}
+
 		dev->net->stats.rx_packets++;
 		dev->net->stats.rx_bytes += skb->len;
 
-		status = netif_rx_ni(skb);
+		napi_gro_receive(napi, skb);
+		work_done++;
 	}
 
 	if (netif_running(dev->net))
-		rx_fill(dev, GFP_KERNEL);
+		rx_fill(dev, GFP_ATOMIC);
+
+	if (work_done < budget) {
+		napi_complete(napi);
+		/* catch frames queued after we last looked */
+		if (!skb_queue_empty(&dev->rx_frames))
+			napi_schedule(napi);
+	}
+
+	return work_done;
 }
 
 static void eth_work(struct work_struct *work)
@@ -478,6 +533,39 @@ static void eth_work(struct work_struct *work)
 		DBG(dev, "work done, flags = 0x%lx\n", dev->todo);
 }
 
+/*
+ * Byte queue limits are updated from both eth_start_xmit() and the
+ * completion handler, which may run in hard irq context and so cannot
+ * take the tx queue lock; dql state is not atomic, so every update goes
+ * through bql_lock instead.
+ */
+static void eth_bql_sent(struct eth_dev *dev, unsigned int bytes)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&dev->bql_lock, flags);
+	netdev_sent_queue(dev->net, bytes);
+	spin_unlock_irqrestore(&dev->bql_lock, flags);
+}
+
+static void eth_bql_completed(struct eth_dev *dev, unsigned int bytes)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&dev->bql_lock, flags);
+	netdev_completed_queue(dev->net, 1, bytes);
+	spin_unlock_irqrestore(&dev->bql_lock, flags);
+}
+
+static void eth_bql_reset(struct eth_dev *dev)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&dev->bql_lock, flags);
+	netdev_reset_queue(dev->net);
+	spin_unlock_irqrestore(&dev->bql_lock, flags);
+}
+
 static void tx_complete(struct usb_ep *ep, struct usb_request *req)
 {
 	struct sk_buff	*skb = req->context;
@@ -504,6 +592,9 @@ static void tx_complete(struct usb_ep *ep, struct usb_request *req)
 	}
 	dev->net->stats.tx_packets++;
 
+	/* byte queue limits; must match what was handed to usb_ep_queue() */
+	eth_bql_completed(dev, req->length);
+
 	spin_lock(&dev->req_lock);
 	list_add_tail(&req->list, &dev->tx_reqs);
 
@@ -541,10 +632,12 @@ static void tx_complete(struct usb_ep *ep, struct usb_request *req)
 				}
 
 				new_req->length = length;
+				eth_bql_sent(dev, length);
 				retval = usb_ep_queue(in, new_req, GFP_ATOMIC);
 				switch (retval) {
 				default:
 					DBG(dev, "tx queue err %d\n", retval);
+					eth_bql_completed(dev, length);
 					new_req->length = 0;
 					spin_lock(&dev->req_lock);
 					list_add_tail(&new_req->list,
@@ -774,10 +867,12 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 		req->no_interrupt = 0;
 	}
 
+	eth_bql_sent(dev, length);
 	retval = usb_ep_queue(in, req, GFP_ATOMIC);
 	switch (retval) {
 	default:
 		DBG(dev, "tx queue err %d\n", retval);
+		eth_bql_completed(dev, length);
 		break;
 	case 0:
 		net->trans_start = jiffies;
@@ -820,6 +915,7 @@ static int eth_open(struct net_device *net)
 	struct gether	*link;
 
 	DBG(dev, "%s\n", __func__);
+	napi_enable(&dev->napi);
 	if (netif_carrier_ok(dev->net))
 		eth_start(dev, GFP_KERNEL);
 
@@ -839,6 +935,7 @@ static int eth_stop(struct net_device *net)
 
 	VDBG(dev, "%s\n", __func__);
 	netif_stop_queue(net);
+	napi_disable(&dev->napi);
 
 	DBG(dev, "stop stats: rx/tx %ld/%ld, errs %ld/%ld\n",
 		dev->net->stats.rx_packets, dev->net->stats.tx_packets,
@@ -999,15 +1096,17 @@ int gether_setup_name(struct usb_gadget *g, u8 ethaddr[ETH_ALEN],
 	dev = netdev_priv(net);
 	spin_lock_init(&dev->lock);
 	spin_lock_init(&dev->req_lock);
+	spin_lock_init(&dev->bql_lock);
 	INIT_WORK(&dev->work, eth_work);
-	INIT_WORK(&dev->rx_work, process_rx_w);
 	INIT_LIST_HEAD(&dev->tx_reqs);
 	INIT_LIST_HEAD(&dev->rx_reqs);
 
 	skb_queue_head_init(&dev->rx_frames);
+	skb_queue_head_init(&dev->rx_recycle);
 
 	/* network device setup */
 	dev->net = net;
+	netif_napi_add(net, &dev->napi, eth_poll, GETHER_NAPI_WEIGHT);
 	snprintf(net->name, sizeof(net->name), "%s%%d", netname);
 
 	if (get_ether_addr(dev_addr, net->dev_addr))
@@ -1135,6 +1234,7 @@ struct net_device *gether_connect(struct gether *link)
 		}
 		spin_unlock(&dev->lock);
 
+		eth_bql_reset(dev);
 		netif_carrier_on(dev->net);
 		if (netif_running(dev->net))
 			eth_start(dev, GFP_ATOMIC);
@@ -1196,6 +1296,7 @@ void gether_disconnect(struct gether *link)
 		spin_lock(&dev->req_lock);
 	}
 	spin_unlock(&dev->req_lock);
+	eth_bql_reset(dev);
 	link->in_ep->driver_data = NULL;
 	link->in_ep->desc = NULL;
 
@@ -1217,6 +1318,11 @@ void gether_disconnect(struct gether *link)
 		dev_kfree_skb_any(skb);
 	spin_unlock(&dev->rx_frames.lock);
 
+	spin_lock(&dev->rx_recycle.lock);
+	while ((skb = __skb_dequeue(&dev->rx_recycle)))
+		dev_kfree_skb_any(skb);
+	spin_unlock(&dev->rx_recycle.lock);
+
 	link->out_ep->driver_data = NULL;
 	link->out_ep->desc = NULL;
 
@@ -1231,22 +1337,5 @@ void gether_disconnect(struct gether *link)
 	spin_unlock(&dev->lock);
 }
 
-static int __init gether_init(void)
-{
-	uether_wq  = create_singlethread_workqueue("uether");
-	if (!uether_wq) {
-		pr_err("%s: Unable to create workqueue: uether\n", __func__);
-		return -ENOMEM;
-	}
-	return 0;
-}
-module_init(gether_init);
-
-static void __exit gether_exit(void)
-{
-	destroy_workqueue(uether_wq);
-
-}
-module_exit(gether_exit);
 MODULE_DESCRIPTION("ethernet over USB driver");
 MODULE_LICENSE("GPL v2");
@@ -1401,6 +1401,7 @@ void ext4_ind_truncate(struct inode *inode)
 	down_write(&ei->i_data_sem);
 
 	ext4_discard_preallocations(inode);
+	ext4_es_remove_extent(inode, last_block, max_block - last_block);
 
 	/*
 	 * The orphan list entry will now protect us from any crash which
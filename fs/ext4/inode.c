@@ -477,12 +477,32 @@ static void set_buffers_da_mapped(struct inode *inode,
 int ext4_map_blocks(handle_t *handle, struct inode *inode,
 		    struct ext4_map_blocks *map, int flags)
 {
+	struct extent_status es;
 	int retval;
 
 	map->m_flags = 0;
 	ext_debug("ext4_map_blocks(): inode %lu, flag %d, max_blocks %u,"
 		  "logical block %lu\n", inode->i_ino, flags, map->m_len,
 		  (unsigned long) map->m_lblk);
+
+	/* Lookup extent status tree firstly */
+	if (ext4_es_lookup_extent(inode, map->m_lblk, &es)) {
+		ext4_es_lru_add(inode);
+		if (ext4_es_is_mapped(&es)) {
+			map->m_pblk = es.es_pblk + map->m_lblk - es.es_lblk;
+			map->m_flags |= ext4_es_is_written(&es) ?
+					EXT4_MAP_MAPPED : EXT4_MAP_UNWRITTEN;
+			retval = es.es_len - (map->m_lblk - es.es_lblk);
+			if (retval > map->m_len)
+				retval = map->m_len;
+			map->m_len = retval;
+		} else {
+			/* delayed or hole: nothing on disk yet */
+			retval = 0;
+		}
+		goto found;
+	}
+
 	/*
 	 * Try to see if we can get the block without requesting a new
 	 * file system block.
@@ -495,8 +515,14 @@ int ext4_map_blocks(handle_t *handle, struct inode *inode,
 		retval = ext4_ind_map_blocks(handle, inode, map, flags &
 					     EXT4_GET_BLOCKS_KEEP_SIZE);
 	}
+	if (retval > 0)
+		ext4_es_insert_extent(inode, map->m_lblk, retval, map->m_pblk,
+				      map->m_flags & EXT4_MAP_UNWRITTEN ?
+				      EXTENT_STATUS_UNWRITTEN :
+				      EXTENT_STATUS_WRITTEN);
 	up_read((&EXT4_I(inode)->i_data_sem));
 
+found:
 	if (retval > 0 && map->m_flags & EXT4_MAP_MAPPED) {
 		int ret = check_block_validity(inode, map);
 		if (ret != 0)
@@ -584,6 +610,25 @@ int ext4_map_blocks(handle_t *handle, struct inode *inode,
 			set_buffers_da_mapped(inode, map);
 	}
 
+	/*
+	 * Newly allocated or converted blocks replace whatever the extent
+	 * status tree knew about the range, including delayed extents.
+	 * Blocks that may still be uninitialized on disk (fallocate,
+	 * direct IO into unwritten extents, end_io conversion) are only
+	 * dropped from the tree, so the next lookup reads the real state.
+	 */
+	if (retval > 0) {
+		if (!(map->m_flags & EXT4_MAP_MAPPED) ||
+		    (flags & (EXT4_GET_BLOCKS_UNINIT_EXT |
+			      EXT4_GET_BLOCKS_PRE_IO |
+			      EXT4_GET_BLOCKS_CONVERT)))
+			ext4_es_remove_extent(inode, map->m_lblk, retval);
+		else
+			ext4_es_insert_extent(inode, map->m_lblk, retval,
+					      map->m_pblk,
+					      EXTENT_STATUS_WRITTEN);
+	}
+
 	up_write((&EXT4_I(inode)->i_data_sem));
 	if (retval > 0 && map->m_flags & EXT4_MAP_MAPPED) {
 		int ret = check_block_validity(inode, map);
@@ -1223,6 +1268,7 @@ static void ext4_da_page_release_reservation(struct page *page,
 	struct inode *inode = page->mapping->host;
 	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
 	int num_clusters;
+	unsigned int first;
 
 	head = page_buffers(page);
 	bh = head;
@@ -1237,6 +1283,15 @@ static void ext4_da_page_release_reservation(struct page *page,
 		curr_off = next_off;
 	} while ((bh = bh->b_this_page) != head);
 
+	/* Forget the delayed extents of the blocks invalidated above */
+	if (to_release) {
+		first = (offset + (1 << inode->i_blkbits) - 1) >>
+			inode->i_blkbits;
+		ext4_es_remove_extent(inode,
+			(page->index << (PAGE_CACHE_SHIFT - inode->i_blkbits)) +
+			first, (PAGE_CACHE_SIZE >> inode->i_blkbits) - first);
+	}
+
 	/* If we have released all the blocks belonging to a cluster, then we
 	 * need to release the reserved space for that cluster. */
 	num_clusters = EXT4_NUM_B2C(sbi, to_release);
@@ -1426,6 +1481,12 @@ static void ext4_da_block_invalidatepages(struct mpage_da_data *mpd)
 	index = mpd->first_page;
 	end   = mpd->next_page - 1;
 
+	/* the delayed blocks of these pages are being thrown away */
+	ext4_es_remove_extent(inode,
+		(ext4_lblk_t)index << (PAGE_CACHE_SHIFT - inode->i_blkbits),
+		(ext4_lblk_t)(end - index + 1) <<
+			(PAGE_CACHE_SHIFT - inode->i_blkbits));
+
 	pagevec_init(&pvec, 0);
 	while (index <= end) {
 		nr_pages = pagevec_lookup(&pvec, mapping, index, PAGEVEC_SIZE);
@@ -1704,6 +1765,7 @@ static int ext4_da_map_blocks(struct inode *inode, sector_t iblock,
 			      struct ext4_map_blocks *map,
 			      struct buffer_head *bh)
 {
+	struct extent_status es;
 	int retval;
 	sector_t invalid_block = ~((sector_t) 0xffff);
 
@@ -1714,6 +1776,36 @@ static int ext4_da_map_blocks(struct inode *inode, sector_t iblock,
 	ext_debug("ext4_da_map_blocks(): inode %lu, max_blocks %u,"
 		  "logical block %lu\n", inode->i_ino, map->m_len,
 		  (unsigned long) map->m_lblk);
+
+	/* Lookup extent status tree firstly */
+	if (ext4_es_lookup_extent(inode, iblock, &es)) {
+		ext4_es_lru_add(inode);
+		if (ext4_es_is_mapped(&es)) {
+			map->m_pblk = es.es_pblk + iblock - es.es_lblk;
+			map->m_flags |= ext4_es_is_written(&es) ?
+					EXT4_MAP_MAPPED : EXT4_MAP_UNWRITTEN;
+			retval = es.es_len - (iblock - es.es_lblk);
+			if (retval > map->m_len)
+				retval = map->m_len;
+			map->m_len = retval;
+			return retval;
+		}
+
+		/*
+		 * Nothing is allocated on disk for this block.  We are only
+		 * called for a buffer which is not mapped, hence not delayed
+		 * either, so a delayed extent here is stale and the block
+		 * needs reserving just like a hole.  Bigalloc still has to
+		 * look at the on-disk tree to find out whether the cluster
+		 * is already allocated.
+		 */
+		if (EXT4_SB(inode->i_sb)->s_cluster_ratio == 1) {
+			down_read((&EXT4_I(inode)->i_data_sem));
+			retval = 0;
+			goto add_delayed;
+		}
+	}
+
 	/*
 	 * Try to see if we can get the block without requesting a new
 	 * file system block.
@@ -1724,6 +1816,13 @@ static int ext4_da_map_blocks(struct inode *inode, sector_t iblock,
 	else
 		retval = ext4_ind_map_blocks(NULL, inode, map, 0);
 
+	if (retval > 0)
+		ext4_es_insert_extent(inode, map->m_lblk, retval, map->m_pblk,
+				      map->m_flags & EXT4_MAP_UNWRITTEN ?
+				      EXTENT_STATUS_UNWRITTEN :
+				      EXTENT_STATUS_WRITTEN);
+
+add_delayed:
 	if (retval == 0) {
 		/*
 		 * XXX: __block_prepare_write() unmaps passed block,
@@ -1743,6 +1842,14 @@ static int ext4_da_map_blocks(struct inode *inode, sector_t iblock,
 		 */
 		map->m_flags &= ~EXT4_MAP_FROM_CLUSTER;
 
+		/*
+		 * Failing to record the delayed extent only costs bigalloc
+		 * and fiemap an accurate view of it; the reservation above
+		 * is tracked by the buffer itself.
+		 */
+		ext4_es_insert_extent(inode, map->m_lblk, 1, ~0,
+				      EXTENT_STATUS_DELAYED);
+
 		map_bh(bh, inode->i_sb, invalid_block);
 		set_buffer_new(bh);
 		set_buffer_delay(bh);
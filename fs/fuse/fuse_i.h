@@ -487,6 +487,9 @@ struct fuse_conn {
 	/** Don't apply umask to creation modes */
 	unsigned dont_mask:1;
 
+	/** Use the page cache for buffered writes, flushed by writepages */
+	unsigned writeback_cache:1;
+
 	/** Are BSD file locking primitives not implemented by fs? */
 	unsigned no_flock:1;
 
@@ -790,4 +793,11 @@ int fuse_dev_release(struct inode *inode, struct file *file);
 
 void fuse_write_update_size(struct inode *inode, loff_t pos);
 
+/**
+ * Send the locally maintained mtime to the filesystem (writeback_cache)
+ */
+int fuse_flush_mtime(struct inode *inode, struct fuse_file *ff);
+
+int fuse_write_inode(struct inode *inode, struct writeback_control *wbc);
+
 #endif /* _FS_FUSE_I_H */
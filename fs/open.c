@@ -241,6 +241,13 @@ int do_fallocate(struct file *file, int mode, loff_t offset, loff_t len)
 	if (IS_IMMUTABLE(inode))
 		return -EPERM;
 
+	/*
+	 * Punching holes in an in-use swapfile (or a loop backing file
+	 * in direct I/O mode) would free blocks still mapped by it.
+	 */
+	if (mode & FALLOC_FL_PUNCH_HOLE && IS_SWAPFILE(inode))
+		return -ETXTBSY;
+
 	/*
 	 * Revalidate the write permissions, in case security policy has
 	 * changed since the files were opened.
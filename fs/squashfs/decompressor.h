@@ -24,34 +24,69 @@
  */
 
 struct squashfs_decompressor {
-	void	*(*init)(struct squashfs_sb_info *, void *, int);
+	void	*(*init)(struct squashfs_sb_info *, void *);
+	void	*(*comp_opts)(struct squashfs_sb_info *, void *, int);
 	void	(*free)(void *);
-	int	(*decompress)(struct squashfs_sb_info *, void **,
-		struct buffer_head **, int, int, int, int, int);
+	int	(*decompress)(struct squashfs_sb_info *, void *,
+		struct buffer_head **, int, int, int,
+		struct squashfs_page_actor *);
 	int	id;
 	char	*name;
 	int	supported;
 };
 
-static inline void squashfs_decompressor_free(struct squashfs_sb_info *msblk,
-	void *s)
+/*
+ * How decompressor streams are shared between readers of one mount: a
+ * single stream behind a mutex, a pool grown on demand, or one stream per
+ * cpu.  Selected at mount time.
+ */
+struct squashfs_decompressor_thread_ops {
+	char	*name;
+	void	*(*create)(struct squashfs_sb_info *, void *);
+	void	(*destroy)(struct squashfs_sb_info *);
+	int	(*decompress)(struct squashfs_sb_info *, struct buffer_head **,
+		int, int, int, struct squashfs_page_actor *);
+	int	(*max_decompressors)(void);
+};
+
+static inline void *squashfs_comp_opts(struct squashfs_sb_info *msblk,
+	void *buff, int length)
 {
-	if (msblk->decompressor)
-		msblk->decompressor->free(s);
+	return msblk->decompressor->comp_opts ?
+		msblk->decompressor->comp_opts(msblk, buff, length) : NULL;
 }
 
 static inline int squashfs_decompress(struct squashfs_sb_info *msblk,
-	void **buffer, struct buffer_head **bh, int b, int offset, int length,
-	int srclength, int pages)
+	struct buffer_head **bh, int b, int offset, int length,
+	struct squashfs_page_actor *output)
+{
+	return msblk->thread_ops->decompress(msblk, bh, b, offset, length,
+		output);
+}
+
+static inline void squashfs_decompressor_destroy(struct squashfs_sb_info *msblk)
+{
+	if (msblk->stream)
+		msblk->thread_ops->destroy(msblk);
+}
+
+static inline int squashfs_max_decompressors(struct squashfs_sb_info *msblk)
 {
-	return msblk->decompressor->decompress(msblk, buffer, bh, b, offset,
-		length, srclength, pages);
+	return msblk->thread_ops->max_decompressors();
 }
 
+extern const struct squashfs_decompressor_thread_ops squashfs_decompressor_single;
+extern const struct squashfs_decompressor_thread_ops squashfs_decompressor_multi;
+extern const struct squashfs_decompressor_thread_ops squashfs_decompressor_percpu;
+
 #ifdef CONFIG_SQUASHFS_XZ
 extern const struct squashfs_decompressor squashfs_xz_comp_ops;
 #endif
 
+#ifdef CONFIG_SQUASHFS_LZ4
+extern const struct squashfs_decompressor squashfs_lz4_comp_ops;
+#endif
+
 #ifdef CONFIG_SQUASHFS_LZO
 extern const struct squashfs_decompressor squashfs_lzo_comp_ops;
 #endif
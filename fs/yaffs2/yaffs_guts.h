@@ -83,6 +83,9 @@
 #define YAFFS_OBJECTID_CHECKPOINT_DATA	0x20
 #define YAFFS_SEQUENCE_CHECKPOINT_DATA  0x21
 
+/* Pseudo object id for block summary chunks */
+#define YAFFS_OBJECTID_SUMMARY		0x10
+
 #define YAFFS_MAX_SHORT_OP_CACHES	20
 
 #define YAFFS_N_TEMP_BUFFERS		6
@@ -281,6 +284,7 @@ struct yaffs_block_info {
 
 #ifdef CONFIG_YAFFS_YAFFS2
 	u32 has_shrink_hdr:1;	/* This block has at least one shrink object header */
+	u32 has_summary:1;	/* This block has a summary in its last chunk(s) */
 	u32 seq_number;		/* block sequence number for yaffs2 */
 #endif
 
@@ -574,6 +578,7 @@ struct yaffs_param {
 	int auto_unicode;
 #endif
 	int always_check_erased;	/* Force chunk erased check always on */
+	int disable_summary;	/* Don't write or use block summaries */
 };
 
 struct yaffs_dev {
@@ -646,6 +651,11 @@ struct yaffs_dev {
 	u32 alloc_page;
 	int alloc_block_finder;	/* Used to search for next allocation block */
 
+	/* Block summaries */
+	struct yaffs_summary_tags *sum_tags;	/* Summary of sum_block so far */
+	int chunks_per_summary;	/* Data chunks per block, 0 if no summaries */
+	int sum_block;		/* Block the summary is being collected for */
+
 	/* Object and Tnode memory management */
 	void *allocator;
 	int n_obj;
@@ -735,6 +745,11 @@ struct yaffs_dev {
 	u32 refresh_count;
 	u32 cache_hits;
 
+	/* Mount statistics */
+	u32 mount_time_ms;	/* How long the last mount took */
+	u32 tags_used;		/* Chunk tags read from NAND while scanning */
+	u32 summary_used;	/* Chunk tags taken from block summaries */
+
 };
 
 /* The CheckpointDevice structure holds the device information that changes at runtime and
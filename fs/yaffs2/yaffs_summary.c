@@ -0,0 +1,354 @@
+/*
+ * YAFFS: Yet Another Flash File System. A NAND-flash specific file system.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/*
+ * Block summaries.
+ *
+ * When a yaffs2 block has been filled, the tags of all its chunks are
+ * written once more into the last chunk(s) of the block.  Scanning a
+ * block then costs one chunk read instead of one read per chunk, which
+ * is what makes mounting without a valid checkpoint bearable on large
+ * devices.
+ *
+ * A summary is only written for a block that was filled in one go from
+ * its first chunk.  Any other block (e.g. the one being allocated from
+ * when power was lost, or one resumed after a mount) is still scanned
+ * chunk by chunk.
+ *
+ * The summary chunks are counted in pages_in_use like any other chunk
+ * so that the free chunk accounting holds.  They are released again by
+ * yaffs_summary_gc() once the block is garbage collected, or as soon as
+ * nothing else in the block is in use.
+ */
+
+#include "yaffs_summary.h"
+#include "yaffs_packedtags2.h"
+#include "yaffs_nand.h"
+#include "yaffs_getblockinfo.h"
+#include "yaffs_bitmap.h"
+#include "yaffs_tagsvalidity.h"
+#include "yaffs_trace.h"
+
+#define YAFFS_SUMMARY_VERSION	1
+
+/* At the start of each summary chunk */
+struct yaffs_summary_header {
+	unsigned version;
+	unsigned block;
+	unsigned seq;
+	unsigned sum;		/* byte sum of the whole summary */
+};
+
+static int yaffs_summary_bytes(struct yaffs_dev *dev)
+{
+	return dev->chunks_per_summary * sizeof(struct yaffs_summary_tags);
+}
+
+static int yaffs_summary_bytes_per_chunk(struct yaffs_dev *dev)
+{
+	return dev->data_bytes_per_chunk - sizeof(struct yaffs_summary_header);
+}
+
+static void yaffs_summary_clear(struct yaffs_dev *dev)
+{
+	memset(dev->sum_tags, 0, yaffs_summary_bytes(dev));
+	dev->sum_block = -1;
+}
+
+static unsigned yaffs_summary_sum(struct yaffs_dev *dev)
+{
+	u8 *sum_buffer = (u8 *) dev->sum_tags;
+	int n_bytes = yaffs_summary_bytes(dev);
+	unsigned sum = 0;
+	int i;
+
+	for (i = 0; i < n_bytes; i++)
+		sum += sum_buffer[i];
+
+	return sum;
+}
+
+int yaffs_summary_init(struct yaffs_dev *dev)
+{
+	int n_bytes;
+	int chunks_used;
+
+	dev->sum_tags = NULL;
+	dev->chunks_per_summary = 0;
+	dev->sum_block = -1;
+
+	/* Inband tags leave no room for a summary and yaffs1 needs none */
+	if (!dev->param.is_yaffs2 || dev->param.inband_tags ||
+	    dev->param.disable_summary)
+		return YAFFS_OK;
+
+	n_bytes = dev->param.chunks_per_block *
+	    sizeof(struct yaffs_summary_tags);
+	chunks_used = (n_bytes + yaffs_summary_bytes_per_chunk(dev) - 1) /
+	    yaffs_summary_bytes_per_chunk(dev);
+
+	/* Not worth it if the summary eats half the block */
+	if (chunks_used * 2 > dev->param.chunks_per_block)
+		return YAFFS_OK;
+
+	dev->chunks_per_summary = dev->param.chunks_per_block - chunks_used;
+	dev->sum_tags = kmalloc(yaffs_summary_bytes(dev), GFP_NOFS);
+	if (!dev->sum_tags) {
+		dev->chunks_per_summary = 0;
+		return YAFFS_FAIL;
+	}
+
+	yaffs_summary_clear(dev);
+
+	yaffs_trace(YAFFS_TRACE_MOUNT,
+		"block summaries: %d data chunks and %d summary chunks per block",
+		dev->chunks_per_summary, chunks_used);
+
+	return YAFFS_OK;
+}
+
+void yaffs_summary_deinit(struct yaffs_dev *dev)
+{
+	kfree(dev->sum_tags);
+	dev->sum_tags = NULL;
+	dev->chunks_per_summary = 0;
+}
+
+static int yaffs_summary_write(struct yaffs_dev *dev, int blk)
+{
+	struct yaffs_block_info *bi = yaffs_get_block_info(dev, blk);
+	struct yaffs_summary_header hdr;
+	struct yaffs_ext_tags tags;
+	u8 *sum_buffer = (u8 *) dev->sum_tags;
+	int n_bytes = yaffs_summary_bytes(dev);
+	int chunk_in_block = dev->chunks_per_summary;
+	int result = YAFFS_OK;
+	int this_tx;
+	u8 *buffer;
+
+	buffer = yaffs_get_temp_buffer(dev, __LINE__);
+
+	hdr.version = YAFFS_SUMMARY_VERSION;
+	hdr.block = blk;
+	hdr.seq = bi->seq_number;
+	hdr.sum = yaffs_summary_sum(dev);
+
+	yaffs_init_tags(&tags);
+	tags.obj_id = YAFFS_OBJECTID_SUMMARY;
+	tags.chunk_id = 1;
+
+	while (n_bytes > 0 && result == YAFFS_OK) {
+		this_tx = min(n_bytes, yaffs_summary_bytes_per_chunk(dev));
+
+		memset(buffer, 0xff, dev->data_bytes_per_chunk);
+		memcpy(buffer, &hdr, sizeof(hdr));
+		memcpy(buffer + sizeof(hdr), sum_buffer, this_tx);
+		tags.n_bytes = sizeof(hdr) + this_tx;
+
+		result = yaffs_wr_chunk_tags_nand(dev,
+				blk * dev->param.chunks_per_block +
+				chunk_in_block, buffer, &tags);
+
+		if (result == YAFFS_OK) {
+			yaffs_set_chunk_bit(dev, blk, chunk_in_block);
+			bi->pages_in_use++;
+			dev->n_free_chunks--;
+		}
+
+		n_bytes -= this_tx;
+		sum_buffer += this_tx;
+		chunk_in_block++;
+		tags.chunk_id++;
+	}
+
+	yaffs_release_temp_buffer(dev, buffer, __LINE__);
+
+	bi->has_summary = 1;
+
+	if (result != YAFFS_OK) {
+		/* A partial summary is useless, forget what we wrote */
+		yaffs_trace(YAFFS_TRACE_ERROR,
+			"block %d summary write failed", blk);
+		yaffs_summary_gc(dev, blk);
+	}
+
+	return result;
+}
+
+/*
+ * Record the tags of a chunk that has just been written.  Once the
+ * data area of the block is full the summary goes out and the rest of
+ * the block is skipped.
+ */
+void yaffs_summary_add(struct yaffs_dev *dev,
+		       struct yaffs_ext_tags *tags, int chunk_in_nand)
+{
+	struct yaffs_packed_tags2_tags_only tags_only;
+	struct yaffs_summary_tags *sum_tags;
+	int blk = chunk_in_nand / dev->param.chunks_per_block;
+	int chunk_in_block = chunk_in_nand % dev->param.chunks_per_block;
+
+	if (!dev->sum_tags)
+		return;
+
+	if (chunk_in_block == 0) {
+		yaffs_summary_clear(dev);
+		dev->sum_block = blk;
+	}
+
+	/* Only blocks we have seen from the start get a summary */
+	if (blk != dev->sum_block || chunk_in_block >= dev->chunks_per_summary)
+		return;
+
+	yaffs_pack_tags2_tags_only(&tags_only, tags);
+	sum_tags = &dev->sum_tags[chunk_in_block];
+	sum_tags->obj_id = tags_only.obj_id;
+	sum_tags->chunk_id = tags_only.chunk_id;
+	sum_tags->n_bytes = tags_only.n_bytes;
+
+	if (chunk_in_block == dev->chunks_per_summary - 1) {
+		yaffs_summary_write(dev, blk);
+		dev->sum_block = -1;
+		if (dev->alloc_block == blk)
+			yaffs_skip_rest_of_block(dev);
+	}
+}
+
+/*
+ * Load and validate the summary of a block, ready for
+ * yaffs_summary_fetch().  On success the summary chunks are marked in
+ * use and the block is flagged as having a summary.
+ */
+int yaffs_summary_read(struct yaffs_dev *dev, int blk)
+{
+	struct yaffs_block_info *bi = yaffs_get_block_info(dev, blk);
+	struct yaffs_summary_header hdr;
+	struct yaffs_ext_tags tags;
+	u8 *sum_buffer = (u8 *) dev->sum_tags;
+	int n_bytes = yaffs_summary_bytes(dev);
+	int chunk_in_block = dev->chunks_per_summary;
+	int result = YAFFS_OK;
+	int this_tx;
+	int i;
+	u8 *buffer;
+
+	if (!dev->sum_tags)
+		return YAFFS_FAIL;
+
+	buffer = yaffs_get_temp_buffer(dev, __LINE__);
+
+	memset(&hdr, 0, sizeof(hdr));
+
+	while (n_bytes > 0 && result == YAFFS_OK) {
+		this_tx = min(n_bytes, yaffs_summary_bytes_per_chunk(dev));
+
+		yaffs_rd_chunk_tags_nand(dev,
+				blk * dev->param.chunks_per_block +
+				chunk_in_block, buffer, &tags);
+		memcpy(&hdr, buffer, sizeof(hdr));
+
+		if (!tags.chunk_used ||
+		    tags.ecc_result == YAFFS_ECC_RESULT_UNFIXED ||
+		    tags.obj_id != YAFFS_OBJECTID_SUMMARY ||
+		    tags.chunk_id !=
+		    chunk_in_block - dev->chunks_per_summary + 1 ||
+		    tags.n_bytes != sizeof(hdr) + this_tx ||
+		    tags.seq_number != bi->seq_number ||
+		    hdr.version != YAFFS_SUMMARY_VERSION ||
+		    hdr.block != blk || hdr.seq != bi->seq_number)
+			result = YAFFS_FAIL;
+		else
+			memcpy(sum_buffer, buffer + sizeof(hdr), this_tx);
+
+		n_bytes -= this_tx;
+		sum_buffer += this_tx;
+		chunk_in_block++;
+	}
+
+	yaffs_release_temp_buffer(dev, buffer, __LINE__);
+
+	if (result == YAFFS_OK && hdr.sum != yaffs_summary_sum(dev)) {
+		yaffs_trace(YAFFS_TRACE_SCAN,
+			"block %d summary has a bad checksum", blk);
+		result = YAFFS_FAIL;
+	}
+
+	if (result != YAFFS_OK)
+		return YAFFS_FAIL;
+
+	for (i = dev->chunks_per_summary; i < chunk_in_block; i++) {
+		yaffs_set_chunk_bit(dev, blk, i);
+		bi->pages_in_use++;
+	}
+	bi->has_summary = 1;
+
+	return YAFFS_OK;
+}
+
+/* Get the tags of a chunk from the summary loaded by yaffs_summary_read() */
+void yaffs_summary_fetch(struct yaffs_dev *dev,
+			 struct yaffs_ext_tags *tags, int chunk_in_block)
+{
+	struct yaffs_packed_tags2_tags_only tags_only;
+	struct yaffs_summary_tags *sum_tags = &dev->sum_tags[chunk_in_block];
+
+	/* The caller fills in the real sequence number */
+	tags_only.seq_number = 0;
+	tags_only.obj_id = sum_tags->obj_id;
+	tags_only.chunk_id = sum_tags->chunk_id;
+	tags_only.n_bytes = sum_tags->n_bytes;
+
+	yaffs_unpack_tags2_tags_only(tags, &tags_only);
+	tags->ecc_result = YAFFS_ECC_RESULT_NO_ERROR;
+}
+
+/* Release the summary chunks of a block */
+void yaffs_summary_gc(struct yaffs_dev *dev, int blk)
+{
+	struct yaffs_block_info *bi = yaffs_get_block_info(dev, blk);
+	int i;
+
+	if (!bi->has_summary)
+		return;
+
+	for (i = dev->chunks_per_summary; i < dev->param.chunks_per_block;
+	     i++) {
+		if (yaffs_check_chunk_bit(dev, blk, i)) {
+			yaffs_clear_chunk_bit(dev, blk, i);
+			bi->pages_in_use--;
+			dev->n_free_chunks++;
+		}
+	}
+
+	bi->has_summary = 0;
+}
+
+/*
+ * Once the summary is all that is left in use in a full block, drop it
+ * so that the block can become dirty and be erased.
+ */
+void yaffs_summary_drop_if_empty(struct yaffs_dev *dev, int blk)
+{
+	struct yaffs_block_info *bi = yaffs_get_block_info(dev, blk);
+	int n_summary = 0;
+	int i;
+
+	if (!bi->has_summary || bi->block_state != YAFFS_BLOCK_STATE_FULL ||
+	    bi->pages_in_use >
+	    dev->param.chunks_per_block - dev->chunks_per_summary)
+		return;
+
+	for (i = dev->chunks_per_summary; i < dev->param.chunks_per_block;
+	     i++) {
+		if (yaffs_check_chunk_bit(dev, blk, i))
+			n_summary++;
+	}
+
+	if (bi->pages_in_use == n_summary)
+		yaffs_summary_gc(dev, blk);
+}
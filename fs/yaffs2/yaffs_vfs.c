@@ -1777,6 +1777,7 @@ struct yaffs_options {
 	int lazy_loading_overridden;
 	int empty_lost_and_found;
 	int empty_lost_and_found_overridden;
+	int no_summary;
 };
 
 #define MAX_OPT_LEN 30
@@ -1833,6 +1834,8 @@ static int yaffs_parse_options(struct yaffs_options *options,
 		} else if (!strcmp(cur_opt, "no-checkpoint")) {
 			options->skip_checkpoint_read = 1;
 			options->skip_checkpoint_write = 1;
+		} else if (!strcmp(cur_opt, "no-summary")) {
+			options->no_summary = 1;
 		} else {
 			printk(KERN_INFO "yaffs: Bad mount option \"%s\"\n",
 			       cur_opt);
@@ -2268,6 +2271,12 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 	if (options.empty_lost_and_found_overridden)
 		param->empty_lost_n_found = options.empty_lost_and_found;
 
+#ifdef CONFIG_YAFFS_DISABLE_SUMMARY
+	param->disable_summary = 1;
+#endif
+	if (options.no_summary)
+		param->disable_summary = 1;
+
 	/* ... and the functions. */
 	if (yaffs_version == 2) {
 		param->write_chunk_tags_fn = nandmtd2_write_chunk_tags;
@@ -2342,6 +2351,13 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 		"yaffs_read_super: guts initialised %s",
 		(err == YAFFS_OK) ? "OK" : "FAILED");
 
+	if (err == YAFFS_OK)
+		printk(KERN_INFO
+		       "yaffs: mounted in %u ms from %s, %u tags read, %u from block summaries\n",
+		       dev->mount_time_ms,
+		       dev->is_checkpointed ? "checkpoint" : "scan",
+		       dev->tags_used, dev->summary_used);
+
 	if (err == YAFFS_OK)
 		yaffs_bg_start(dev);
 
@@ -2452,6 +2468,8 @@ static char *yaffs_dump_dev_part0(char *buf, struct yaffs_dev *dev)
 			param->n_reserved_blocks);
 	buf += sprintf(buf, "always_check_erased... %d\n",
 			param->always_check_erased);
+	buf += sprintf(buf, "disable_summary....... %d\n",
+			param->disable_summary);
 
 	return buf;
 }
@@ -2467,6 +2485,12 @@ static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 	    sprintf(buf, "n_erased_blocks....... %d\n", dev->n_erased_blocks);
 	buf +=
 	    sprintf(buf, "blocks_in_checkpt..... %d\n", dev->blocks_in_checkpt);
+	buf +=
+	    sprintf(buf, "chunks_per_summary.... %d\n", dev->chunks_per_summary);
+	buf += sprintf(buf, "\n");
+	buf += sprintf(buf, "mount_time_ms......... %u\n", dev->mount_time_ms);
+	buf += sprintf(buf, "tags_used............. %u\n", dev->tags_used);
+	buf += sprintf(buf, "summary_used.......... %u\n", dev->summary_used);
 	buf += sprintf(buf, "\n");
 	buf += sprintf(buf, "n_tnodes.............. %d\n", dev->n_tnodes);
 	buf += sprintf(buf, "n_obj................. %d\n", dev->n_obj);
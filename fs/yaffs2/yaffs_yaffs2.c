@@ -20,6 +20,7 @@
 #include "yaffs_getblockinfo.h"
 #include "yaffs_verify.h"
 #include "yaffs_attribs.h"
+#include "yaffs_summary.h"
 
 /*
  * Checkpoints are really no benefit on very small partitions.
@@ -340,6 +341,59 @@ static int yaffs2_wr_checkpt_dev(struct yaffs_dev *dev)
 
 }
 
+/*
+ * The checksum only tells us the checkpoint was read back as written.
+ * Before trusting it, make sure what it describes fits this device,
+ * e.g. it was not written for a partition of a different size.  Falling
+ * back to a scan is always safe.
+ */
+static int yaffs2_checkpt_dev_ok(struct yaffs_dev *dev,
+				 struct yaffs_checkpt_dev *cp)
+{
+	int n_blocks = dev->internal_end_block - dev->internal_start_block + 1;
+
+	if (cp->n_erased_blocks < 0 || cp->n_erased_blocks > n_blocks)
+		return 0;
+
+	if (cp->n_free_chunks < 0 ||
+	    cp->n_free_chunks > n_blocks * dev->param.chunks_per_block)
+		return 0;
+
+	if (cp->alloc_block >= 0 &&
+	    (cp->alloc_block < dev->internal_start_block ||
+	     cp->alloc_block > dev->internal_end_block ||
+	     cp->alloc_page > dev->param.chunks_per_block))
+		return 0;
+
+	if (cp->seq_number < YAFFS_LOWEST_SEQUENCE_NUMBER ||
+	    cp->seq_number >= YAFFS_HIGHEST_SEQUENCE_NUMBER)
+		return 0;
+
+	return 1;
+}
+
+static int yaffs2_checkpt_blocks_ok(struct yaffs_dev *dev)
+{
+	struct yaffs_block_info *bi = dev->block_info;
+	int i;
+
+	for (i = dev->internal_start_block; i <= dev->internal_end_block;
+	     i++, bi++) {
+		if (bi->block_state >= YAFFS_NUMBER_OF_BLOCK_STATES ||
+		    bi->pages_in_use < 0 ||
+		    bi->pages_in_use > dev->param.chunks_per_block)
+			return 0;
+
+		/* Summary chunks we can't account for, e.g. mounted
+		 * with summaries off this time round.
+		 */
+		if (bi->has_summary && !dev->chunks_per_summary)
+			return 0;
+	}
+
+	return 1;
+}
+
 static int yaffs2_rd_checkpt_dev(struct yaffs_dev *dev)
 {
 	struct yaffs_checkpt_dev cp;
@@ -356,6 +410,12 @@ static int yaffs2_rd_checkpt_dev(struct yaffs_dev *dev)
 	if (cp.struct_type != sizeof(cp))
 		return 0;
 
+	if (!yaffs2_checkpt_dev_ok(dev, &cp)) {
+		yaffs_trace(YAFFS_TRACE_CHECKPOINT,
+			"checkpoint device values do not fit this device");
+		return 0;
+	}
+
 	yaffs_checkpt_dev_to_dev(dev, &cp);
 
 	n_bytes = n_blocks * sizeof(struct yaffs_block_info);
@@ -364,6 +424,12 @@ static int yaffs2_rd_checkpt_dev(struct yaffs_dev *dev)
 
 	if (!ok)
 		return 0;
+
+	if (!yaffs2_checkpt_blocks_ok(dev)) {
+		yaffs_trace(YAFFS_TRACE_CHECKPOINT,
+			"checkpoint block info is inconsistent");
+		return 0;
+	}
 	n_bytes = n_blocks * dev->chunk_bit_stride;
 
 	ok = (yaffs2_checkpt_rd(dev, dev->chunk_bits, n_bytes) == n_bytes);
@@ -983,6 +1049,7 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 	int found_chunks;
 	int equiv_id;
 	int alloc_failed = 0;
+	int summary_available;
 
 	struct yaffs_block_index *block_index = NULL;
 	int alt_block_index = 0;
@@ -1102,6 +1169,9 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 		deleted = 0;
 
+		/* With a summary we need not read the tags of each chunk */
+		summary_available = yaffs_summary_read(dev, blk);
+
 		/* For each chunk in each block that needs scanning.... */
 		found_chunks = 0;
 		for (c = dev->param.chunks_per_block - 1;
@@ -1114,8 +1184,23 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 			chunk = blk * dev->param.chunks_per_block + c;
 
-			result = yaffs_rd_chunk_tags_nand(dev, chunk, NULL,
-							  &tags);
+			if (summary_available &&
+			    c >= dev->chunks_per_summary) {
+				/* The summary itself, already accounted for */
+				if (!yaffs_check_chunk_bit(dev, blk, c))
+					dev->n_free_chunks++;
+				continue;
+			}
+
+			if (summary_available) {
+				yaffs_summary_fetch(dev, &tags, c);
+				tags.seq_number = bi->seq_number;
+				dev->summary_used++;
+			} else {
+				result = yaffs_rd_chunk_tags_nand(dev, chunk,
+								  NULL, &tags);
+				dev->tags_used++;
+			}
 
 			/* Let's have a good look at this chunk... */
 
@@ -1176,6 +1261,12 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 				dev->n_free_chunks++;
 
+			} else if (tags.obj_id == YAFFS_OBJECTID_SUMMARY) {
+				/* A summary we could not use, just dead space */
+				found_chunks = 1;
+
+				dev->n_free_chunks++;
+
 			} else if (tags.obj_id > YAFFS_MAX_OBJECT_ID ||
 				   tags.chunk_id > YAFFS_MAX_CHUNK_ID ||
 				   (tags.chunk_id > 0
@@ -1564,6 +1655,8 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 		bi->block_state = state;
 
+		yaffs_summary_drop_if_empty(dev, blk);
+
 		/* Now let's see if it was dirty */
 		if (bi->pages_in_use == 0 &&
 		    !bi->has_shrink_hdr &&
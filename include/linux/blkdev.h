@@ -133,6 +133,14 @@ struct request {
 #ifdef CONFIG_BLK_CGROUP
 	unsigned long long start_time_ns;
 	unsigned long long io_start_time_ns;    /* when passed to hardware */
+#endif
+#ifdef CONFIG_BLK_WBT
+	unsigned int wbt_flags;
+	u64 wbt_issue_ns;			/* when passed to the driver */
+#endif
+#ifdef CONFIG_BLK_LAT_HIST
+	u64 hist_start_ns;			/* when set up from a bio */
+	u64 hist_issue_ns;			/* when passed to the driver */
 #endif
 	/* Number of scatter-gather DMA addr+len pairs after
 	 * physical address coalescing is performed.
@@ -403,6 +411,16 @@ struct request_queue {
 	/* Throttle data */
 	struct throtl_data *td;
 #endif
+
+#ifdef CONFIG_BLK_WBT
+	/* Writeback throttling */
+	struct rq_wb		*rq_wb;
+#endif
+
+#ifdef CONFIG_BLK_LAT_HIST
+	/* Per-cpu latency histograms */
+	struct blk_lat_hist __percpu *lat_hist;
+#endif
 };
 
 #define QUEUE_FLAG_QUEUED	1	/* uses generic tag queueing */
@@ -0,0 +1,32 @@
+#ifndef __LZ4_H__
+#define __LZ4_H__
+/*
+ * LZ4 Kernel Interface
+ *
+ * Copyright (C) 2011-2012, Yann Collet.
+ * BSD 2-Clause License (http://www.opensource.org/licenses/bsd-license.php)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Only block decompression is provided; the stream format is the raw
+ * LZ4 block as produced by LZ4_compress() and LZ4_compressHC().
+ */
+
+/*
+ * lz4_decompress_unknownoutputsize()
+ *	src	: source address of the compressed data
+ *	src_len	: is the input size, therefore the compressed size
+ *	dest	: output buffer address of the decompressed data
+ *	dest_len: is the max size of the destination buffer, which is
+ *			updated with the actual decompressed size on return
+ *	return	: Success if return 0
+ *		  Error if return (< 0)
+ *	note	: Destination buffer must be already allocated.
+ *		  The whole of src is consumed; the decoder never reads
+ *		  past src + src_len nor writes past dest + *dest_len.
+ */
+int lz4_decompress_unknownoutputsize(const unsigned char *src, size_t src_len,
+		unsigned char *dest, size_t *dest_len);
+#endif
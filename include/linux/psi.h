@@ -0,0 +1,54 @@
+#ifndef _LINUX_PSI_H
+#define _LINUX_PSI_H
+
+#include <linux/psi_types.h>
+#include <linux/sched.h>
+#include <linux/poll.h>
+
+struct seq_file;
+struct cgroup;
+struct cftype;
+
+#ifdef CONFIG_PSI
+
+extern bool psi_disabled;
+extern struct psi_group psi_system;
+
+void psi_init(void);
+
+void psi_task_change(struct task_struct *task, int clear, int set);
+
+void psi_memstall_tick(struct task_struct *task, int cpu);
+void psi_memstall_enter(unsigned long *flags);
+void psi_memstall_leave(unsigned long *flags);
+
+int psi_show(struct seq_file *s, struct psi_group *group, enum psi_res res);
+
+struct psi_trigger *psi_trigger_create(struct psi_group *group,
+			const char *buf, enum psi_res res);
+void psi_trigger_destroy(struct psi_trigger *t);
+
+unsigned int psi_trigger_poll(struct psi_trigger *t, struct file *file,
+			poll_table *wait);
+
+#ifdef CONFIG_CGROUP_SCHED
+struct psi_group *psi_group_alloc(void);
+void psi_group_free(struct psi_group *group);
+
+int psi_cgroup_register_event(struct psi_group *group,
+			struct eventfd_ctx *eventfd, const char *args,
+			enum psi_res res);
+void psi_cgroup_unregister_event(struct psi_group *group,
+			struct eventfd_ctx *eventfd);
+#endif
+
+#else /* CONFIG_PSI */
+
+static inline void psi_init(void) {}
+
+static inline void psi_memstall_enter(unsigned long *flags) {}
+static inline void psi_memstall_leave(unsigned long *flags) {}
+
+#endif /* CONFIG_PSI */
+
+#endif /* _LINUX_PSI_H */
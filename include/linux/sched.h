@@ -755,6 +755,31 @@ extern struct user_struct root_user;
 struct backing_dev_info;
 struct reclaim_state;
 
+#ifdef CONFIG_SCHED_LATENCY_HIST
+/*
+ * log2 latency histograms in units of 1024ns, so that bucketing is a
+ * shift and an fls: bucket 0 counts events shorter than one unit,
+ * bucket n those in [2^(n-1), 2^n) units, the last bucket everything
+ * above.
+ */
+#define SCHED_LAT_BUCKETS	20
+
+enum sched_lat_type {
+	SCHED_LAT_WAKEUP,	/* wakeup to first run */
+	SCHED_LAT_WAIT,		/* any wait on a runqueue */
+	SCHED_LAT_SLICE,	/* time on the cpu per switch-in */
+	SCHED_LAT_NR_TYPES,
+};
+
+struct sched_lat_hist {
+	unsigned int count[SCHED_LAT_NR_TYPES][SCHED_LAT_BUCKETS];
+};
+
+struct seq_file;
+extern void sched_lat_hist_show(struct seq_file *m,
+				const struct sched_lat_hist *hist);
+#endif /* CONFIG_SCHED_LATENCY_HIST */
+
 #if defined(CONFIG_SCHEDSTATS) || defined(CONFIG_TASK_DELAY_ACCT)
 struct sched_info {
 	/* cumulative counters */
@@ -764,6 +789,10 @@ struct sched_info {
 	/* timestamps */
 	unsigned long long last_arrival,/* when we last ran on a cpu */
 			   last_queued;	/* when we were last queued to run */
+#ifdef CONFIG_SCHED_LATENCY_HIST
+	unsigned long long last_woken;	/* when we were last woken up */
+	struct sched_lat_hist lat_hist;
+#endif
 };
 #endif /* defined(CONFIG_SCHEDSTATS) || defined(CONFIG_TASK_DELAY_ACCT) */
 
@@ -1356,12 +1385,20 @@ struct task_struct {
 	/* Revert to default priority/policy when forking */
 	unsigned sched_reset_on_fork:1;
 	unsigned sched_contributes_to_load:1;
+#ifdef CONFIG_PSI
+	unsigned sched_psi_wake_requeue:1;
+#endif
 
 #ifdef CONFIG_GENERIC_HARDIRQS
 	/* IRQ handler threads */
 	unsigned irq_thread:1;
 #endif
 
+#ifdef CONFIG_PSI
+	/* Pressure stall state */
+	unsigned int psi_flags;
+#endif
+
 	unsigned long atomic_flags; /* Flags needing atomic access. */
 
 	pid_t pid;
@@ -1838,6 +1875,7 @@ extern int task_free_unregister(struct notifier_block *n);
 #define PF_FROZEN	0x00010000	/* frozen for system suspend */
 #define PF_FSTRANS	0x00020000	/* inside a filesystem transaction */
 #define PF_KSWAPD	0x00040000	/* I am kswapd */
+#define PF_MEMSTALL	0x00080000	/* Stalled due to lack of memory */
 #define PF_LESS_THROTTLE 0x00100000	/* Throttle me less: I clean memory */
 #define PF_KTHREAD	0x00200000	/* I am a kernel thread */
 #define PF_RANDOMIZE	0x00400000	/* randomize virtual address space */
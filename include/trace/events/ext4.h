@@ -14,6 +14,7 @@ struct ext4_prealloc_space;
 struct ext4_inode_info;
 struct mpage_da_data;
 struct ext4_map_blocks;
+struct extent_status;
 struct ext4_extent;
 
 #define EXT4_I(inode) (container_of(inode, struct ext4_inode_info, vfs_inode))
@@ -2055,6 +2056,63 @@ TRACE_EVENT(ext4_ext_remove_space_done,
 		  (unsigned short) __entry->eh_entries)
 );
 
+TRACE_EVENT(ext4_es_lookup_extent,
+	TP_PROTO(struct inode *inode, ext4_lblk_t lblk,
+		 struct extent_status *es),
+
+	TP_ARGS(inode, lblk, es),
+
+	TP_STRUCT__entry(
+		__field(	dev_t,		dev		)
+		__field(	ino_t,		ino		)
+		__field(	ext4_lblk_t,	lblk		)
+		__field(	ext4_lblk_t,	es_lblk		)
+		__field(	ext4_lblk_t,	es_len		)
+		__field(	ext4_fsblk_t,	es_pblk		)
+		__field(	unsigned char,	es_status	)
+		__field(	int,		found		)
+	),
+
+	TP_fast_assign(
+		__entry->dev		= inode->i_sb->s_dev;
+		__entry->ino		= inode->i_ino;
+		__entry->lblk		= lblk;
+		__entry->es_lblk	= es ? es->es_lblk : 0;
+		__entry->es_len		= es ? es->es_len : 0;
+		__entry->es_pblk	= es ? es->es_pblk : 0;
+		__entry->es_status	= es ? es->es_status : 0;
+		__entry->found		= es != NULL;
+	),
+
+	TP_printk("dev %d,%d ino %lu lblk %u found %d [%u/%u) %llu %x",
+		  MAJOR(__entry->dev), MINOR(__entry->dev),
+		  (unsigned long) __entry->ino, __entry->lblk,
+		  __entry->found, __entry->es_lblk, __entry->es_len,
+		  __entry->es_pblk, __entry->es_status)
+);
+
+TRACE_EVENT(ext4_es_shrink,
+	TP_PROTO(struct super_block *sb, int nr_shrunk, int cache_cnt),
+
+	TP_ARGS(sb, nr_shrunk, cache_cnt),
+
+	TP_STRUCT__entry(
+		__field(	dev_t,	dev			)
+		__field(	int,	nr_shrunk		)
+		__field(	int,	cache_cnt		)
+	),
+
+	TP_fast_assign(
+		__entry->dev		= sb->s_dev;
+		__entry->nr_shrunk	= nr_shrunk;
+		__entry->cache_cnt	= cache_cnt;
+	),
+
+	TP_printk("dev %d,%d nr_shrunk %d cache_cnt %d",
+		  MAJOR(__entry->dev), MINOR(__entry->dev),
+		  __entry->nr_shrunk, __entry->cache_cnt)
+);
+
 #endif /* _TRACE_EXT4_H */
 
 /* This part must be outside protection */
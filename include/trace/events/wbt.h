@@ -0,0 +1,151 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM wbt
+
+#if !defined(_TRACE_WBT_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_WBT_H
+
+#include <linux/tracepoint.h>
+#include <linux/backing-dev.h>
+#include <linux/device.h>
+
+/**
+ * wbt_stat - trace stats for blk_wb
+ * @bdi: backing device of the queue
+ * @nr_reads: reads completed in the window
+ * @nr_writes: writes completed in the window
+ * @min_read_lat: fastest read of the window, in nsecs
+ */
+TRACE_EVENT(wbt_stat,
+
+	TP_PROTO(struct backing_dev_info *bdi, unsigned int nr_reads,
+		 unsigned int nr_writes, u64 min_read_lat),
+
+	TP_ARGS(bdi, nr_reads, nr_writes, min_read_lat),
+
+	TP_STRUCT__entry(
+		__array(char, name, 32)
+		__field(unsigned int, nr_reads)
+		__field(unsigned int, nr_writes)
+		__field(u64, min_read_lat)
+	),
+
+	TP_fast_assign(
+		strncpy(__entry->name, bdi->dev ? dev_name(bdi->dev) : "",
+			32);
+		__entry->nr_reads	= nr_reads;
+		__entry->nr_writes	= nr_writes;
+		__entry->min_read_lat	= min_read_lat;
+	),
+
+	TP_printk("%s: reads=%u, writes=%u, rmin=%llu",
+		  __entry->name, __entry->nr_reads, __entry->nr_writes,
+		  (unsigned long long)__entry->min_read_lat)
+);
+
+/**
+ * wbt_lat - trace latency event
+ * @bdi: backing device of the queue
+ * @lat: latency that triggered the event, or the new target, in nsecs
+ */
+TRACE_EVENT(wbt_lat,
+
+	TP_PROTO(struct backing_dev_info *bdi, u64 lat),
+
+	TP_ARGS(bdi, lat),
+
+	TP_STRUCT__entry(
+		__array(char, name, 32)
+		__field(unsigned long, lat)
+	),
+
+	TP_fast_assign(
+		strncpy(__entry->name, bdi->dev ? dev_name(bdi->dev) : "",
+			32);
+		__entry->lat = div_u64(lat, 1000);
+	),
+
+	TP_printk("%s: latency %lluus", __entry->name,
+		  (unsigned long long)__entry->lat)
+);
+
+/**
+ * wbt_step - trace wb event step
+ * @bdi: backing device of the queue
+ * @msg: context message
+ * @step: the current scale step count
+ * @window: the current monitoring window
+ * @bg: the current background queue limit
+ * @normal: the current normal writeback limit
+ * @max: the current max throughput writeback limit
+ */
+TRACE_EVENT(wbt_step,
+
+	TP_PROTO(struct backing_dev_info *bdi, const char *msg,
+		 int step, unsigned long window, unsigned int bg,
+		 unsigned int normal, unsigned int max),
+
+	TP_ARGS(bdi, msg, step, window, bg, normal, max),
+
+	TP_STRUCT__entry(
+		__array(char, name, 32)
+		__field(const char *, msg)
+		__field(int, step)
+		__field(unsigned long, window)
+		__field(unsigned int, bg)
+		__field(unsigned int, normal)
+		__field(unsigned int, max)
+	),
+
+	TP_fast_assign(
+		strncpy(__entry->name, bdi->dev ? dev_name(bdi->dev) : "",
+			32);
+		__entry->msg	= msg;
+		__entry->step	= step;
+		__entry->window	= div_u64(window, 1000);
+		__entry->bg	= bg;
+		__entry->normal	= normal;
+		__entry->max	= max;
+	),
+
+	TP_printk("%s: %s: step=%d, window=%luus, background=%u, normal=%u, max=%u",
+		  __entry->name, __entry->msg, __entry->step, __entry->window,
+		  __entry->bg, __entry->normal, __entry->max)
+);
+
+/**
+ * wbt_timer - trace wb timer event
+ * @bdi: backing device of the queue
+ * @status: timer state status
+ * @step: the current scale step count
+ * @inflight: tracked writes inflight
+ */
+TRACE_EVENT(wbt_timer,
+
+	TP_PROTO(struct backing_dev_info *bdi, unsigned int status,
+		 int step, unsigned int inflight),
+
+	TP_ARGS(bdi, status, step, inflight),
+
+	TP_STRUCT__entry(
+		__array(char, name, 32)
+		__field(unsigned int, status)
+		__field(int, step)
+		__field(unsigned int, inflight)
+	),
+
+	TP_fast_assign(
+		strncpy(__entry->name, bdi->dev ? dev_name(bdi->dev) : "",
+			32);
+		__entry->status		= status;
+		__entry->step		= step;
+		__entry->inflight	= inflight;
+	),
+
+	TP_printk("%s: status=%u, step=%d, inflight=%u", __entry->name,
+		  __entry->status, __entry->step, __entry->inflight)
+);
+
+#endif /* _TRACE_WBT_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
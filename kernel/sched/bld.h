@@ -60,20 +60,93 @@ static int select_cpu_for_wakeup(int task_type, struct cpumask *mask)
 	return cpu;
 }
 
-static int bld_pick_cpu_cfs(struct task_struct *p, int sd_flags, int wake_flags)
+/*
+ * The cfs_rq list is kept sorted by load.weight, lightest first, so the
+ * least loaded cpu allowed by @mask is normally found at the head.
+ */
+static int bld_least_loaded_cpu(struct task_struct *p, struct cpumask *mask)
 {
 	struct cfs_rq *cfs;
 	unsigned long flags;
-	unsigned int cpu = smp_processor_id();
+	unsigned int cpu;
 
 	read_lock_irqsave(&cfs_list_lock, flags);
 	list_for_each_entry(cfs, &cfs_rq_head, bld_cfs_list) {
 		cpu = cpu_of(rq_of_cfs(cfs));
-		if (cpu_online(cpu))
-			break;
+		if (cpumask_test_cpu(cpu, mask) &&
+		    cpumask_test_cpu(cpu, tsk_cpus_allowed(p)) &&
+		    cpu_online(cpu)) {
+			read_unlock_irqrestore(&cfs_list_lock, flags);
+			return cpu;
+		}
 	}
 	read_unlock_irqrestore(&cfs_list_lock, flags);
-	return cpu;
+	return smp_processor_id();
+}
+
+/*
+ * An idle cpu that went idle less than sysctl_sched_migration_cost ago
+ * is most likely still in a shallow C-state and cheap to wake.
+ */
+static inline int bld_idle_shallow(int cpu)
+{
+	struct rq *rq = cpu_rq(cpu);
+	u64 stamp = rq->idle_stamp;
+
+	if (!stamp)
+		return 0;
+	return (s64)(local_clock() - stamp) < (s64)sysctl_sched_migration_cost;
+}
+
+/*
+ * Look for an idle cpu sharing the last level cache with the previous
+ * cpu of @p, then with the waker.  Among several idle cpus the one that
+ * went idle most recently wins.  If only long-idle cpus are left and the
+ * waker is about to sleep anyway, run on the waker instead of pulling a
+ * cpu out of deep idle.  Returns -1 if nothing suitable was found.
+ */
+static int bld_select_idle_sibling(struct task_struct *p, int this_cpu,
+				   int wake_flags)
+{
+	int prev_cpu = task_cpu(p);
+	int targets[2] = { prev_cpu, this_cpu };
+	struct sched_domain *sd;
+	int i, t, best = -1;
+	u64 stamp, best_stamp = 0;
+
+	if (idle_cpu(prev_cpu) && bld_idle_shallow(prev_cpu))
+		return prev_cpu;
+
+	rcu_read_lock();
+	for (t = 0; t < 2 && best < 0; t++) {
+		if (t && cpus_share_cache(prev_cpu, this_cpu))
+			break;
+		sd = rcu_dereference(per_cpu(sd_llc, targets[t]));
+		if (!sd)
+			continue;
+		for_each_cpu_and(i, sched_domain_span(sd), tsk_cpus_allowed(p)) {
+			if (!idle_cpu(i))
+				continue;
+			stamp = cpu_rq(i)->idle_stamp;
+			if (best < 0 || stamp > best_stamp) {
+				best = i;
+				best_stamp = stamp;
+			}
+		}
+	}
+	rcu_read_unlock();
+
+	if (best >= 0 && !bld_idle_shallow(best) && (wake_flags & WF_SYNC) &&
+	    cpumask_test_cpu(this_cpu, tsk_cpus_allowed(p)) &&
+	    cpu_rq(this_cpu)->nr_running <= 1)
+		return this_cpu;
+
+	return best;
+}
+
+static int bld_pick_cpu_cfs(struct task_struct *p, int sd_flags, int wake_flags)
+{
+	return bld_least_loaded_cpu(p, (struct cpumask *)cpu_online_mask);
 }
 
 static int bld_pick_cpu_rt(struct task_struct *p, int sd_flags, int wake_flags)
@@ -106,17 +179,22 @@ static int bld_pick_cpu_domain(struct task_struct *p, int sd_flags, int wake_fla
 		}
 	}
 
-	if (want_affine)
+	if (want_affine || !cpu_rq(task_cpu(p))->sd)
 		tmpmask = tsk_cpus_allowed(p);
 	else
 		tmpmask = sched_domain_span(cpu_rq(task_cpu(p))->sd);
 
 	if (rt_task(p))
-		cpu = select_cpu_for_wakeup(0, tmpmask);
-	else
-		cpu = select_cpu_for_wakeup(1, tmpmask);
+		return select_cpu_for_wakeup(0, tmpmask);
 
-	return cpu;
+	if (sd_flags & SD_BALANCE_WAKE) {
+		int target = bld_select_idle_sibling(p, cpu, wake_flags);
+
+		if (target >= 0)
+			return target;
+	}
+
+	return bld_least_loaded_cpu(p, tmpmask);
 }
 
 static void track_load_rt(struct rq *rq, struct task_struct *p)
@@ -157,51 +235,75 @@ static int bld_get_cpu(struct task_struct *p, int sd_flags, int wake_flags)
 	return cpu;
 }
 
+static inline int bld_cfs_in_order(struct cfs_rq *cfs)
+{
+	struct list_head *prev = cfs->bld_cfs_list.prev;
+	struct list_head *next = cfs->bld_cfs_list.next;
+	unsigned long load = cfs->load.weight;
+
+	if (prev != &cfs_rq_head &&
+	    list_entry(prev, struct cfs_rq, bld_cfs_list)->load.weight > load)
+		return 0;
+	if (next != &cfs_rq_head &&
+	    list_entry(next, struct cfs_rq, bld_cfs_list)->load.weight < load)
+		return 0;
+	return 1;
+}
+
+/*
+ * Move @cfs to its place in the sorted cfs_rq list after its load
+ * changed.  A single enqueue or dequeue rarely moves it by more than a
+ * slot or two, and the unlocked check keeps cfs_list_lock off the fast
+ * path when the order still holds.
+ */
+static void track_load_cfs(struct cfs_rq *cfs)
+{
+	struct cfs_rq *pos;
+	unsigned long load, flag;
+
+	if (bld_cfs_in_order(cfs))
+		return;
+
+	write_lock_irqsave(&cfs_list_lock, flag);
+	load = cfs->load.weight;
+	while (cfs->bld_cfs_list.next != &cfs_rq_head) {
+		pos = list_entry(cfs->bld_cfs_list.next, struct cfs_rq,
+				 bld_cfs_list);
+		if (pos->load.weight >= load)
+			break;
+		list_move(&cfs->bld_cfs_list, &pos->bld_cfs_list);
+	}
+	while (cfs->bld_cfs_list.prev != &cfs_rq_head) {
+		pos = list_entry(cfs->bld_cfs_list.prev, struct cfs_rq,
+				 bld_cfs_list);
+		if (pos->load.weight <= load)
+			break;
+		list_move_tail(&cfs->bld_cfs_list, &pos->bld_cfs_list);
+	}
+	write_unlock_irqrestore(&cfs_list_lock, flag);
+}
+
 static void bld_track_load_activate(struct rq *rq, struct task_struct *p)
 {
-	unsigned long flag;
-	if (rt_task(p)) {
+	if (rt_task(p))
 		track_load_rt(rq, p);
-	} else {
-		if (rq->cfs.pos != 2) {
-			struct cfs_rq *last;
-			last = list_entry(cfs_rq_head.prev, struct cfs_rq, bld_cfs_list);
-			if (rq->cfs.load.weight >= last->load.weight) {
-				write_lock_irqsave(&cfs_list_lock, flag);
-				list_del(&rq->cfs.bld_cfs_list);
-				list_add_tail(&rq->cfs.bld_cfs_list, &cfs_rq_head);
-				rq->cfs.pos = 2; last->pos = 1;
-				write_unlock_irqrestore(&cfs_list_lock, flag);
-			}
-		}
-	}
+	else
+		track_load_cfs(&rq->cfs);
 }
 
 static void bld_track_load_deactivate(struct rq *rq, struct task_struct *p)
 {
-	unsigned long flag;
-	if (rt_task(p)) {
+	if (rt_task(p))
 		track_load_rt(rq, p);
-	} else {
-		if (rq->cfs.pos != 0) {
-			struct cfs_rq *first;
-			first = list_entry(cfs_rq_head.next, struct cfs_rq, bld_cfs_list);
-			if (rq->cfs.load.weight <= first->load.weight) {
-				write_lock_irqsave(&cfs_list_lock, flag);
-				list_del(&rq->cfs.bld_cfs_list);
-				list_add(&rq->cfs.bld_cfs_list, &cfs_rq_head);
-				rq->cfs.pos = 0; first->pos = 1;
-				write_unlock_irqrestore(&cfs_list_lock, flag);
-			}
-		}
-	}
+	else
+		track_load_cfs(&rq->cfs);
 }
 #else
-static inline void bld_track_load_activate(struct rq *rq)
+static inline void bld_track_load_activate(struct rq *rq, struct task_struct *p)
 {
 }
 
-static inline void bld_track_load_deactivate(struct rq *rq)
+static inline void bld_track_load_deactivate(struct rq *rq, struct task_struct *p)
 {
 }
 #endif /* CONFIG_BLD */
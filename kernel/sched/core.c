@@ -743,6 +743,7 @@ static void enqueue_task(struct rq *rq, struct task_struct *p, int flags)
 {
 	update_rq_clock(rq);
 	sched_info_queued(p);
+	psi_enqueue(p, flags & ENQUEUE_WAKEUP);
 	p->sched_class->enqueue_task(rq, p, flags);
 	bld_track_load_activate(rq, p);
 }
@@ -751,6 +752,7 @@ static void dequeue_task(struct rq *rq, struct task_struct *p, int flags)
 {
 	update_rq_clock(rq);
 	sched_info_dequeued(p);
+	psi_dequeue(p, flags & DEQUEUE_SLEEP);
 	p->sched_class->dequeue_task(rq, p, flags);
 	bld_track_load_deactivate(rq, p);
 }
@@ -1445,6 +1447,7 @@ static void
 ttwu_do_wakeup(struct rq *rq, struct task_struct *p, int wake_flags)
 {
 	trace_sched_wakeup(p, true);
+	sched_lat_woken(rq, p);
 	check_preempt_curr(rq, p, wake_flags);
 
 	p->state = TASK_RUNNING;
@@ -1671,6 +1674,7 @@ try_to_wake_up(struct task_struct *p, unsigned int state, int wake_flags)
 	cpu = select_task_rq(p, SD_BALANCE_WAKE, wake_flags);
 	if (src_cpu != cpu) {
 		wake_flags |= WF_MIGRATED;
+		psi_ttwu_dequeue(p);
 		set_task_cpu(p, cpu);
 	}
 #endif /* CONFIG_SMP */
@@ -1771,6 +1775,11 @@ static void __sched_fork(struct task_struct *p)
 	memset(&p->se.statistics, 0, sizeof(p->se.statistics));
 #endif
 
+#ifdef CONFIG_PSI
+	p->psi_flags = 0;
+	p->sched_psi_wake_requeue = 0;
+#endif
+
 	INIT_LIST_HEAD(&p->rt.run_list);
 
 #ifdef CONFIG_PREEMPT_NOTIFIERS
@@ -2300,7 +2309,7 @@ static long calc_load_fold_active(struct rq *this_rq)
 /*
  * a1 = a0 * e + a * (1 - e)
  */
-static unsigned long
+unsigned long
 calc_load(unsigned long load, unsigned long exp, unsigned long active)
 {
 	load *= exp;
@@ -2309,6 +2318,74 @@ calc_load(unsigned long load, unsigned long exp, unsigned long active)
 	return load >> FSHIFT;
 }
 
+/**
+ * fixed_power_int - compute: x^n, in O(log n) time
+ *
+ * @x:         base of the power
+ * @frac_bits: fractional bits of @x
+ * @n:         power to raise @x to.
+ *
+ * By exploiting the relation between the definition of the natural power
+ * function: x^n := x*x*...*x (x multiplied by itself for n times), and
+ * the binary encoding of numbers used by computers: n := \Sum n_i * 2^i,
+ * (where: n_i \elem {0, 1}, the binary vector representing n),
+ * we find: x^n := x^(\Sum n_i * 2^i) := \Prod x^(n_i * 2^i), which is
+ * of course trivially computable in O(log_2 n), the length of our binary
+ * vector.
+ */
+static unsigned long
+fixed_power_int(unsigned long x, unsigned int frac_bits, unsigned int n)
+{
+	unsigned long result = 1UL << frac_bits;
+
+	if (n) for (;;) {
+		if (n & 1) {
+			result *= x;
+			result += 1UL << (frac_bits - 1);
+			result >>= frac_bits;
+		}
+		n >>= 1;
+		if (!n)
+			break;
+		x *= x;
+		x += 1UL << (frac_bits - 1);
+		x >>= frac_bits;
+	}
+
+	return result;
+}
+
+/*
+ * a1 = a0 * e + a * (1 - e)
+ *
+ * a2 = a1 * e + a * (1 - e)
+ *    = (a0 * e + a * (1 - e)) * e + a * (1 - e)
+ *    = a0 * e^2 + a * (1 - e) * (1 + e)
+ *
+ * a3 = a2 * e + a * (1 - e)
+ *    = (a0 * e^2 + a * (1 - e) * (1 + e)) * e + a * (1 - e)
+ *    = a0 * e^3 + a * (1 - e) * (1 + e + e^2)
+ *
+ *  ...
+ *
+ * an = a0 * e^n + a * (1 - e) * (1 + e + ... + e^n-1) [1]
+ *    = a0 * e^n + a * (1 - e) * (1 - e^n)/(1 - e)
+ *    = a0 * e^n + a * (1 - e^n)
+ *
+ * [1] application of the geometric series:
+ *
+ *              n         1 - x^(n+1)
+ *     S_n := \Sum x^i = -------------
+ *             i=0          1 - x
+ */
+unsigned long
+calc_load_n(unsigned long load, unsigned long exp,
+	    unsigned long active, unsigned int n)
+{
+
+	return calc_load(load, fixed_power_int(exp, FSHIFT, n), active);
+}
+
 #ifdef CONFIG_NO_HZ
 /*
  * Handle NO_HZ for the global load-average.
@@ -2427,74 +2504,6 @@ static long calc_load_fold_idle(void)
 	return delta;
 }
 
-/**
- * fixed_power_int - compute: x^n, in O(log n) time
- *
- * @x:         base of the power
- * @frac_bits: fractional bits of @x
- * @n:         power to raise @x to.
- *
- * By exploiting the relation between the definition of the natural power
- * function: x^n := x*x*...*x (x multiplied by itself for n times), and
- * the binary encoding of numbers used by computers: n := \Sum n_i * 2^i,
- * (where: n_i \elem {0, 1}, the binary vector representing n),
- * we find: x^n := x^(\Sum n_i * 2^i) := \Prod x^(n_i * 2^i), which is
- * of course trivially computable in O(log_2 n), the length of our binary
- * vector.
- */
-static unsigned long
-fixed_power_int(unsigned long x, unsigned int frac_bits, unsigned int n)
-{
-	unsigned long result = 1UL << frac_bits;
-
-	if (n) for (;;) {
-		if (n & 1) {
-			result *= x;
-			result += 1UL << (frac_bits - 1);
-			result >>= frac_bits;
-		}
-		n >>= 1;
-		if (!n)
-			break;
-		x *= x;
-		x += 1UL << (frac_bits - 1);
-		x >>= frac_bits;
-	}
-
-	return result;
-}
-
-/*
- * a1 = a0 * e + a * (1 - e)
- *
- * a2 = a1 * e + a * (1 - e)
- *    = (a0 * e + a * (1 - e)) * e + a * (1 - e)
- *    = a0 * e^2 + a * (1 - e) * (1 + e)
- *
- * a3 = a2 * e + a * (1 - e)
- *    = (a0 * e^2 + a * (1 - e) * (1 + e)) * e + a * (1 - e)
- *    = a0 * e^3 + a * (1 - e) * (1 + e + e^2)
- *
- *  ...
- *
- * an = a0 * e^n + a * (1 - e) * (1 + e + ... + e^n-1) [1]
- *    = a0 * e^n + a * (1 - e) * (1 - e^n)/(1 - e)
- *    = a0 * e^n + a * (1 - e^n)
- *
- * [1] application of the geometric series:
- *
- *              n         1 - x^(n+1)
- *     S_n := \Sum x^i = -------------
- *             i=0          1 - x
- */
-static unsigned long
-calc_load_n(unsigned long load, unsigned long exp,
-	    unsigned long active, unsigned int n)
-{
-
-	return calc_load(load, fixed_power_int(exp, FSHIFT, n), active);
-}
-
 /*
  * NO_HZ can leave us missing all per-cpu ticks calling
  * calc_load_account_active(), but since an idle CPU folds its delta into
@@ -3281,6 +3290,7 @@ void scheduler_tick(void)
 	update_rq_clock(rq);
 	update_cpu_load_active(rq);
 	curr->sched_class->task_tick(rq, curr, 0);
+	psi_task_tick(rq);
 	raw_spin_unlock(&rq->lock);
 
 	perf_event_task_tick();
@@ -3477,6 +3487,10 @@ need_resched:
 #ifndef CONFIG_BLD
 	if (unlikely(!rq->nr_running))
 		idle_balance(cpu, rq);
+#else
+	/* BLD wakeup placement uses this to tell shallow from deep idle */
+	if (unlikely(!rq->nr_running))
+		rq->idle_stamp = rq->clock;
 #endif
 
 	put_prev_task(rq, prev);
@@ -7291,6 +7305,9 @@ void __init sched_init(void)
 	list_add(&root_task_group.list, &task_groups);
 	INIT_LIST_HEAD(&root_task_group.children);
 	INIT_LIST_HEAD(&root_task_group.siblings);
+#ifdef CONFIG_PSI
+	root_task_group.psi = &psi_system;
+#endif
 	autogroup_init(&init_task);
 
 #endif /* CONFIG_CGROUP_SCHED */
@@ -7373,7 +7390,6 @@ void __init sched_init(void)
 #ifdef CONFIG_BLD
 		INIT_LIST_HEAD(&rq->cfs.bld_cfs_list);
 		list_add_tail(&rq->cfs.bld_cfs_list, &cfs_rq_head);
-		rq->cfs.pos = 0;
 
 		INIT_LIST_HEAD(&rq->rt.bld_rt_list);
 		list_add_tail(&rq->rt.bld_rt_list, &rt_rq_head);
@@ -7420,6 +7436,8 @@ void __init sched_init(void)
 #endif
 	init_sched_fair_class();
 
+	psi_init();
+
 	scheduler_running = 1;
 
 #ifdef CONFIG_BLD
@@ -7667,6 +7685,9 @@ void sched_move_task(struct task_struct *tsk)
 	int on_rq, running;
 	unsigned long flags;
 	struct rq *rq;
+#ifdef CONFIG_PSI
+	unsigned int psi_flags;
+#endif
 
 	rq = task_rq_lock(tsk, &flags);
 
@@ -7678,12 +7699,27 @@ void sched_move_task(struct task_struct *tsk)
 	if (unlikely(running))
 		tsk->sched_class->put_prev_task(rq, tsk);
 
+#ifdef CONFIG_PSI
+	/*
+	 * A sleeping task carries its iowait or memstall state along to
+	 * the new group; runnable state is moved by the requeue.
+	 */
+	psi_flags = tsk->psi_flags;
+	if (psi_flags)
+		psi_task_change(tsk, psi_flags, 0);
+#endif
+
 	tg = container_of(task_subsys_state_check(tsk, cpu_cgroup_subsys_id,
 				lockdep_is_held(&tsk->sighand->siglock)),
 			  struct task_group, css);
 	tg = autogroup_task_group(tsk, tg);
 	tsk->sched_task_group = tg;
 
+#ifdef CONFIG_PSI
+	if (psi_flags)
+		psi_task_change(tsk, 0, psi_flags);
+#endif
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	if (tsk->sched_class->task_move_group)
 		tsk->sched_class->task_move_group(tsk, on_rq);
@@ -8002,6 +8038,15 @@ static struct cgroup_subsys_state *cpu_cgroup_create(struct cgroup *cgrp)
 	if (IS_ERR(tg))
 		return ERR_PTR(-ENOMEM);
 
+#ifdef CONFIG_PSI
+	tg->psi = psi_group_alloc();
+	if (IS_ERR(tg->psi)) {
+		tg->psi = NULL;
+		sched_destroy_group(tg);
+		return ERR_PTR(-ENOMEM);
+	}
+#endif
+
 	return &tg->css;
 }
 
@@ -8009,6 +8054,9 @@ static void cpu_cgroup_destroy(struct cgroup *cgrp)
 {
 	struct task_group *tg = cgroup_tg(cgrp);
 
+#ifdef CONFIG_PSI
+	psi_group_free(tg->psi);
+#endif
 	sched_destroy_group(tg);
 }
 
@@ -8366,6 +8414,33 @@ static u64 cpu_rt_period_read_uint(struct cgroup *cgrp, struct cftype *cft)
 }
 #endif /* CONFIG_RT_GROUP_SCHED */
 
+#ifdef CONFIG_PSI
+static int cpu_pressure_show(struct cgroup *cgrp, struct cftype *cft,
+			     struct seq_file *m)
+{
+	struct psi_group *group = cgroup_tg(cgrp)->psi;
+
+	if (!group)
+		return -EOPNOTSUPP;
+
+	return psi_show(m, group, cft->private);
+}
+
+static int cpu_pressure_register_event(struct cgroup *cgrp,
+		struct cftype *cft, struct eventfd_ctx *eventfd,
+		const char *args)
+{
+	return psi_cgroup_register_event(cgroup_tg(cgrp)->psi, eventfd, args,
+					 cft->private);
+}
+
+static void cpu_pressure_unregister_event(struct cgroup *cgrp,
+		struct cftype *cft, struct eventfd_ctx *eventfd)
+{
+	psi_cgroup_unregister_event(cgroup_tg(cgrp)->psi, eventfd);
+}
+#endif /* CONFIG_PSI */
+
 static struct cftype cpu_files[] = {
 	{
 		.name = "notify_on_migrate",
@@ -8407,6 +8482,29 @@ static struct cftype cpu_files[] = {
 		.write_u64 = cpu_rt_period_write_uint,
 	},
 #endif
+#ifdef CONFIG_PSI
+	{
+		.name = "io_pressure",
+		.private = PSI_IO,
+		.read_seq_string = cpu_pressure_show,
+		.register_event = cpu_pressure_register_event,
+		.unregister_event = cpu_pressure_unregister_event,
+	},
+	{
+		.name = "memory_pressure",
+		.private = PSI_MEM,
+		.read_seq_string = cpu_pressure_show,
+		.register_event = cpu_pressure_register_event,
+		.unregister_event = cpu_pressure_unregister_event,
+	},
+	{
+		.name = "cpu_pressure",
+		.private = PSI_CPU,
+		.read_seq_string = cpu_pressure_show,
+		.register_event = cpu_pressure_register_event,
+		.unregister_event = cpu_pressure_unregister_event,
+	},
+#endif
 };
 
 static int cpu_cgroup_populate(struct cgroup_subsys *ss, struct cgroup *cont)
@@ -3,6 +3,7 @@
 #include <linux/mutex.h>
 #include <linux/spinlock.h>
 #include <linux/stop_machine.h>
+#include <linux/psi.h>
 
 #include "cpupri.h"
 
@@ -135,6 +136,11 @@ struct task_group {
 #endif
 
 	struct cfs_bandwidth cfs_bandwidth;
+
+#ifdef CONFIG_PSI
+	/* pressure stall tracking, NULL for autogroups */
+	struct psi_group *psi;
+#endif
 };
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
@@ -274,7 +280,6 @@ struct cfs_rq {
 
 #ifdef CONFIG_BLD
 	struct list_head bld_cfs_list;
-	char pos;
 #endif
 };
 
@@ -896,6 +901,11 @@ extern void init_rt_bandwidth(struct rt_bandwidth *rt_b, u64 period, u64 runtime
 
 extern void update_idle_cpu_load(struct rq *this_rq);
 
+extern unsigned long calc_load(unsigned long load, unsigned long exp,
+			       unsigned long active);
+extern unsigned long calc_load_n(unsigned long load, unsigned long exp,
+				 unsigned long active, unsigned int n);
+
 #ifdef CONFIG_CGROUP_CPUACCT
 #include <linux/cgroup.h>
 /* track cpu usage of a group of tasks and its child groups */
@@ -103,9 +103,57 @@ static const struct file_operations proc_schedstat_operations = {
 	.release = single_release,
 };
 
+#ifdef CONFIG_SCHED_LATENCY_HIST
+void sched_lat_hist_show(struct seq_file *m, const struct sched_lat_hist *hist)
+{
+	int i;
+
+	seq_printf(m, "%-10s %10s %10s %10s\n",
+		   "1024ns", "wakeup", "wait", "slice");
+	for (i = 0; i < SCHED_LAT_BUCKETS; i++) {
+		char label[16];
+
+		if (i < SCHED_LAT_BUCKETS - 1)
+			snprintf(label, sizeof(label), "<%u", 1U << i);
+		else
+			snprintf(label, sizeof(label), ">=%u", 1U << (i - 1));
+		seq_printf(m, "%-10s %10u %10u %10u\n", label,
+			   hist->count[SCHED_LAT_WAKEUP][i],
+			   hist->count[SCHED_LAT_WAIT][i],
+			   hist->count[SCHED_LAT_SLICE][i]);
+	}
+}
+
+static int show_schedlat(struct seq_file *seq, void *v)
+{
+	int cpu;
+
+	for_each_online_cpu(cpu) {
+		seq_printf(seq, "cpu%d\n", cpu);
+		sched_lat_hist_show(seq, &cpu_rq(cpu)->rq_sched_info.lat_hist);
+	}
+	return 0;
+}
+
+static int schedlat_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, show_schedlat, NULL);
+}
+
+static const struct file_operations proc_schedlat_operations = {
+	.open    = schedlat_open,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+#endif /* CONFIG_SCHED_LATENCY_HIST */
+
 static int __init proc_schedstat_init(void)
 {
 	proc_create("schedstat", 0, NULL, &proc_schedstat_operations);
+#ifdef CONFIG_SCHED_LATENCY_HIST
+	proc_create("schedlat", 0, NULL, &proc_schedlat_operations);
+#endif
 	return 0;
 }
 module_init(proc_schedstat_init);
@@ -47,6 +47,36 @@ rq_sched_info_depart(struct rq *rq, unsigned long long delta)
 # define schedstat_set(var, val)	do { } while (0)
 #endif
 
+#ifdef CONFIG_SCHED_LATENCY_HIST
+/*
+ * Expects runqueue lock to be held; the per-task and per-cpu counters
+ * are only ever written by the cpu owning that runqueue.
+ */
+static inline void
+sched_lat_account(struct task_struct *t, int type, unsigned long long delta)
+{
+	unsigned long long units = delta >> 10;	/* 1024ns */
+	int bucket = units ? fls64(units) : 0;
+
+	if (bucket >= SCHED_LAT_BUCKETS)
+		bucket = SCHED_LAT_BUCKETS - 1;
+	t->sched_info.lat_hist.count[type][bucket]++;
+	task_rq(t)->rq_sched_info.lat_hist.count[type][bucket]++;
+}
+
+static inline void sched_lat_woken(struct rq *rq, struct task_struct *p)
+{
+	if (rq->curr != p)
+		p->sched_info.last_woken = rq->clock;
+}
+#else
+static inline void
+sched_lat_account(struct task_struct *t, int type, unsigned long long delta)
+{}
+static inline void sched_lat_woken(struct rq *rq, struct task_struct *p)
+{}
+#endif
+
 #if defined(CONFIG_SCHEDSTATS) || defined(CONFIG_TASK_DELAY_ACCT)
 static inline void sched_info_reset_dequeued(struct task_struct *t)
 {
@@ -81,14 +111,25 @@ static void sched_info_arrive(struct task_struct *t)
 {
 	unsigned long long now = task_rq(t)->clock, delta = 0;
 
-	if (t->sched_info.last_queued)
+	if (t->sched_info.last_queued) {
 		delta = now - t->sched_info.last_queued;
+		/* nothing was measured if the task was never queued */
+		sched_lat_account(t, SCHED_LAT_WAIT, delta);
+	}
 	sched_info_reset_dequeued(t);
 	t->sched_info.run_delay += delta;
 	t->sched_info.last_arrival = now;
 	t->sched_info.pcount++;
 
 	rq_sched_info_arrive(task_rq(t), delta);
+
+#ifdef CONFIG_SCHED_LATENCY_HIST
+	if (t->sched_info.last_woken) {
+		sched_lat_account(t, SCHED_LAT_WAKEUP,
+				  now - t->sched_info.last_woken);
+		t->sched_info.last_woken = 0;
+	}
+#endif
 }
 
 /*
@@ -116,6 +157,7 @@ static inline void sched_info_depart(struct task_struct *t)
 					t->sched_info.last_arrival;
 
 	rq_sched_info_depart(task_rq(t), delta);
+	sched_lat_account(t, SCHED_LAT_SLICE, delta);
 
 	if (t->state == TASK_RUNNING)
 		sched_info_queued(t);
@@ -155,6 +197,98 @@ sched_info_switch(struct task_struct *prev, struct task_struct *next)
 #define sched_info_switch(t, next)		do { } while (0)
 #endif /* CONFIG_SCHEDSTATS || CONFIG_TASK_DELAY_ACCT */
 
+#ifdef CONFIG_PSI
+/*
+ * PSI tracks state that persists across sleeps, such as iowaits and
+ * memory stalls. As a result, it has to distinguish between sleeps,
+ * where a task's runnable state changes, and requeues, where a task
+ * and its state are being moved between CPUs and runqueues.
+ */
+static inline void psi_enqueue(struct task_struct *p, bool wakeup)
+{
+	int clear = 0, set = TSK_RUNNING;
+
+	if (psi_disabled)
+		return;
+
+	if (!wakeup || p->sched_psi_wake_requeue) {
+		if (p->flags & PF_MEMSTALL)
+			set |= TSK_MEMSTALL;
+		if (p->sched_psi_wake_requeue)
+			p->sched_psi_wake_requeue = 0;
+	} else {
+		if (p->in_iowait)
+			clear |= TSK_IOWAIT;
+	}
+
+	psi_task_change(p, clear, set);
+}
+
+static inline void psi_dequeue(struct task_struct *p, bool sleep)
+{
+	int clear = TSK_RUNNING, set = 0;
+
+	if (psi_disabled)
+		return;
+
+	if (!sleep) {
+		if (p->flags & PF_MEMSTALL)
+			clear |= TSK_MEMSTALL;
+	} else {
+		if (p->in_iowait)
+			set |= TSK_IOWAIT;
+	}
+
+	psi_task_change(p, clear, set);
+}
+
+/*
+ * A sleeping task is being woken up on a different CPU: drop its
+ * sleep state from the old runqueue, psi_enqueue() restores it on the
+ * new one.  Called with p->pi_lock held and p in TASK_WAKING.
+ */
+static inline void psi_ttwu_dequeue(struct task_struct *p)
+{
+	if (psi_disabled)
+		return;
+
+	if (unlikely(p->in_iowait || (p->flags & PF_MEMSTALL))) {
+		struct rq *rq;
+		int clear = 0;
+
+		if (p->in_iowait)
+			clear |= TSK_IOWAIT;
+		if (p->flags & PF_MEMSTALL)
+			clear |= TSK_MEMSTALL;
+
+		for (;;) {
+			rq = task_rq(p);
+			raw_spin_lock(&rq->lock);
+			if (likely(rq == task_rq(p)))
+				break;
+			raw_spin_unlock(&rq->lock);
+		}
+		psi_task_change(p, clear, 0);
+		p->sched_psi_wake_requeue = 1;
+		raw_spin_unlock(&rq->lock);
+	}
+}
+
+static inline void psi_task_tick(struct rq *rq)
+{
+	if (psi_disabled)
+		return;
+
+	if (unlikely(rq->curr->flags & PF_MEMSTALL))
+		psi_memstall_tick(rq->curr, cpu_of(rq));
+}
+#else
+static inline void psi_enqueue(struct task_struct *p, bool wakeup) {}
+static inline void psi_dequeue(struct task_struct *p, bool sleep) {}
+static inline void psi_ttwu_dequeue(struct task_struct *p) {}
+static inline void psi_task_tick(struct rq *rq) {}
+#endif /* CONFIG_PSI */
+
 /*
  * The following are functions that support scheduler-internal time accounting.
  * These functions are generally called at the timer tick.  None of this depends
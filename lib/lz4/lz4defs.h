@@ -0,0 +1,33 @@
+/*
+ * lz4defs.h -- architecture specific defines
+ *
+ * Copyright (C) 2013, LG Electronics, Kyungsik Lee <kyungsik.lee@lge.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#if defined(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS) || defined(__x86_64__)
+#define LZ4_ARCH64_COPY	1
+#endif
+
+#ifdef LZ4_ARCH64_COPY
+#define LZ4_COPY8(dst, src)	\
+		put_unaligned(get_unaligned((const u64 *)(src)), (u64 *)(dst))
+#else
+#define LZ4_COPY8(dst, src)	\
+	do {							\
+		put_unaligned(get_unaligned((const u32 *)(src)),	\
+				(u32 *)(dst));			\
+		put_unaligned(get_unaligned((const u32 *)(src) + 1),	\
+				(u32 *)(dst) + 1);			\
+	} while (0)
+#endif
+
+/* Sequence token layout */
+#define MINMATCH	4
+#define ML_BITS		4
+#define ML_MASK		((1U << ML_BITS) - 1)
+#define RUN_BITS	(8 - ML_BITS)
+#define RUN_MASK	((1U << RUN_BITS) - 1)
@@ -60,6 +60,7 @@
 #include <linux/mm_inline.h>
 #include <linux/migrate.h>
 #include <linux/page-debug-flags.h>
+#include <linux/psi.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -701,6 +702,50 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 	spin_unlock(&zone->lock);
 }
 
+/*
+ * Frees blocks from the high-order PCP lists until at least count base
+ * pages have been returned, taking one block from each non-empty list in
+ * turn.  Returns the number of base pages freed.
+ */
+static int free_pcppages_bulk_high(struct zone *zone, int count,
+					struct per_cpu_pages *pcp)
+{
+	int pindex = MIGRATE_PCPTYPES - 1;
+	int freed = 0;
+
+	spin_lock(&zone->lock);
+	zone->pages_scanned = 0;
+
+	while (freed < count && freed < pcp->high_order_count) {
+		struct page *page;
+		struct list_head *list;
+		unsigned int order;
+		int mt;
+
+		do {
+			if (++pindex == NR_PCP_LISTS)
+				pindex = MIGRATE_PCPTYPES;
+			list = &pcp->lists[pindex];
+		} while (list_empty(list));
+
+		order = pindex / MIGRATE_PCPTYPES;
+		page = list_entry(list->prev, struct page, lru);
+		mt = get_pageblock_migratetype(page);
+		/* must delete as __free_one_page list manipulates */
+		list_del(&page->lru);
+		__free_one_page(page, zone, order, page_private(page));
+		trace_mm_page_pcpu_drain(page, order, page_private(page));
+		if (is_migrate_cma(mt))
+			__mod_zone_page_state(zone, NR_FREE_CMA_PAGES,
+					      1 << order);
+		freed += 1 << order;
+	}
+	__mod_zone_page_state(zone, NR_FREE_PAGES, freed);
+	spin_unlock(&zone->lock);
+
+	return freed;
+}
+
 static void free_one_page(struct zone *zone, struct page *page, int order,
 				int migratetype)
 {
@@ -739,20 +784,61 @@ static bool free_pages_prepare(struct page *page, unsigned int order)
 	return true;
 }
 
+/*
+ * Free a block of order 1..PAGE_ALLOC_COSTLY_ORDER to the per-cpu lists.
+ * Must be called with interrupts disabled.
+ */
+static void free_pcp_high_order(struct zone *zone, struct page *page,
+				unsigned int order, int migratetype)
+{
+	struct per_cpu_pages *pcp;
+
+	/*
+	 * Same rules as for order-0 pages in free_hot_cold_page(): the
+	 * real pageblock type is kept for the buddy allocator, the
+	 * remapped one only picks the pcp list.
+	 */
+	set_page_private(page, migratetype);
+	if (migratetype >= MIGRATE_PCPTYPES) {
+		if (unlikely(migratetype == MIGRATE_ISOLATE) ||
+			     is_migrate_cma(migratetype)) {
+			free_one_page(zone, page, order, migratetype);
+			return;
+		}
+		migratetype = MIGRATE_MOVABLE;
+	}
+
+	/* The block may be handed out again without __GFP_COMP */
+	if (unlikely(PageCompound(page)))
+		if (unlikely(destroy_compound_page(page, order)))
+			return;
+
+	pcp = &this_cpu_ptr(zone->pageset)->pcp;
+	list_add(&page->lru, &pcp->lists[order_to_pindex(migratetype, order)]);
+	pcp->high_order_count += 1 << order;
+	if (pcp->high_order_count >= pcp->high_order_high)
+		pcp->high_order_count -= free_pcppages_bulk_high(zone,
+					pcp->high_order_batch, pcp);
+}
+
 static void __free_pages_ok(struct page *page, unsigned int order)
 {
 	unsigned long flags;
 	int wasMlocked = __TestClearPageMlocked(page);
+	int migratetype;
 
 	if (!free_pages_prepare(page, order))
 		return;
 
+	migratetype = get_pageblock_migratetype(page);
 	local_irq_save(flags);
 	if (unlikely(wasMlocked))
 		free_page_mlock(page);
 	__count_vm_events(PGFREE, 1 << order);
-	free_one_page(page_zone(page), page, order,
-					get_pageblock_migratetype(page));
+	if (order && order <= PAGE_ALLOC_COSTLY_ORDER)
+		free_pcp_high_order(page_zone(page), page, order, migratetype);
+	else
+		free_one_page(page_zone(page), page, order, migratetype);
 	local_irq_restore(flags);
 }
 
@@ -1238,6 +1324,9 @@ void drain_zone_pages(struct zone *zone, struct per_cpu_pages *pcp)
 		to_drain = pcp->count;
 	free_pcppages_bulk(zone, to_drain, pcp);
 	pcp->count -= to_drain;
+	if (pcp->high_order_count)
+		pcp->high_order_count -= free_pcppages_bulk_high(zone,
+					pcp->high_order_batch, pcp);
 	local_irq_restore(flags);
 }
 #endif
@@ -1266,6 +1355,11 @@ static void drain_pages(unsigned int cpu)
 			free_pcppages_bulk(zone, pcp->count, pcp);
 			pcp->count = 0;
 		}
+		if (pcp->high_order_count) {
+			free_pcppages_bulk_high(zone, pcp->high_order_count,
+						pcp);
+			pcp->high_order_count = 0;
+		}
 		local_irq_restore(flags);
 	}
 }
@@ -1309,7 +1403,7 @@ void drain_all_pages(void)
 		bool has_pcps = false;
 		for_each_populated_zone(zone) {
 			pcp = per_cpu_ptr(zone->pageset, cpu);
-			if (pcp->pcp.count) {
+			if (pcp->pcp.count || pcp->pcp.high_order_count) {
 				has_pcps = true;
 				break;
 			}
@@ -1524,6 +1618,20 @@ struct page *buffered_rmqueue(struct zone *preferred_zone,
 	struct page *page;
 	int cold = !!(gfp_flags & __GFP_COLD);
 
+	if (unlikely(gfp_flags & __GFP_NOFAIL)) {
+		/*
+		 * __GFP_NOFAIL is not to be used in new code.
+		 *
+		 * All __GFP_NOFAIL callers should be fixed so that they
+		 * properly detect and handle allocation failures.
+		 *
+		 * We most definitely don't want callers attempting to
+		 * allocate greater than order-1 page units with
+		 * __GFP_NOFAIL.
+		 */
+		WARN_ON_ONCE(order > 1);
+	}
+
 again:
 	if (likely(order == 0)) {
 		struct per_cpu_pages *pcp;
@@ -1548,20 +1656,28 @@ again:
 
 		list_del(&page->lru);
 		pcp->count--;
+	} else if (order <= PAGE_ALLOC_COSTLY_ORDER) {
+		struct per_cpu_pages *pcp;
+		struct list_head *list;
+
+		local_irq_save(flags);
+		pcp = &this_cpu_ptr(zone->pageset)->pcp;
+		list = &pcp->lists[order_to_pindex(migratetype, order)];
+		if (list_empty(list)) {
+			__count_vm_event(PCP_HIGH_ORDER_MISS);
+			pcp->high_order_count += rmqueue_bulk(zone, order,
+					max(pcp->high_order_batch >> order, 1),
+					list, migratetype, cold,
+					gfp_flags & __GFP_CMA) << order;
+			if (unlikely(list_empty(list)))
+				goto failed;
+		} else
+			__count_vm_event(PCP_HIGH_ORDER_HIT);
+
+		page = list_entry(list->next, struct page, lru);
+		list_del(&page->lru);
+		pcp->high_order_count -= 1 << order;
 	} else {
-		if (unlikely(gfp_flags & __GFP_NOFAIL)) {
-			/*
-			 * __GFP_NOFAIL is not to be used in new code.
-			 *
-			 * All __GFP_NOFAIL callers should be fixed so that they
-			 * properly detect and handle allocation failures.
-			 *
-			 * We most definitely don't want callers attempting to
-			 * allocate greater than order-1 page units with
-			 * __GFP_NOFAIL.
-			 */
-			WARN_ON_ONCE(order > 1);
-		}
 		spin_lock_irqsave(&zone->lock, flags);
 		if (gfp_flags & __GFP_CMA)
 			page = __rmqueue_cma(zone, order, migratetype);
@@ -2160,6 +2276,8 @@ __alloc_pages_direct_compact(gfp_t gfp_mask, unsigned int order,
 	unsigned long *did_some_progress)
 {
 	struct page *page;
+	unsigned long start;
+	unsigned long pflags;
 
 	if (!order)
 		return NULL;
@@ -2169,10 +2287,16 @@ __alloc_pages_direct_compact(gfp_t gfp_mask, unsigned int order,
 		return NULL;
 	}
 
+	start = jiffies;
+	psi_memstall_enter(&pflags);
 	current->flags |= PF_MEMALLOC;
 	*did_some_progress = try_to_compact_pages(zonelist, order, gfp_mask,
 						nodemask, sync_migration);
 	current->flags &= ~PF_MEMALLOC;
+	psi_memstall_leave(&pflags);
+	if (*did_some_progress != COMPACT_SKIPPED)
+		count_vm_events(COMPACTSTALL_MS,
+				jiffies_to_msecs(jiffies - start));
 	if (*did_some_progress != COMPACT_SKIPPED) {
 
 		/* Page migration frees to the PCP lists but we want merging */
@@ -2231,11 +2355,13 @@ __perform_reclaim(gfp_t gfp_mask, unsigned int order, struct zonelist *zonelist,
 {
 	struct reclaim_state reclaim_state;
 	int progress;
+	unsigned long pflags;
 
 	cond_resched();
 
 	/* We now go into synchronous reclaim */
 	cpuset_memory_pressure_bump();
+	psi_memstall_enter(&pflags);
 	current->flags |= PF_MEMALLOC;
 	lockdep_set_current_reclaim_state(gfp_mask);
 	reclaim_state.reclaimed_slab = 0;
@@ -2246,6 +2372,7 @@ __perform_reclaim(gfp_t gfp_mask, unsigned int order, struct zonelist *zonelist,
 	current->reclaim_state = NULL;
 	lockdep_clear_current_reclaim_state();
 	current->flags &= ~PF_MEMALLOC;
+	psi_memstall_leave(&pflags);
 
 	cond_resched();
 
@@ -2906,9 +3033,13 @@ void show_free_areas(unsigned int filter)
 
 			pageset = per_cpu_ptr(zone->pageset, cpu);
 
-			printk("CPU %4d: hi:%5d, btch:%4d usd:%4d\n",
+			printk("CPU %4d: hi:%5d, btch:%4d usd:%4d "
+			       "high-order hi:%5d, btch:%4d usd:%4d\n",
 			       cpu, pageset->pcp.high,
-			       pageset->pcp.batch, pageset->pcp.count);
+			       pageset->pcp.batch, pageset->pcp.count,
+			       pageset->pcp.high_order_high,
+			       pageset->pcp.high_order_batch,
+			       pageset->pcp.high_order_count);
 		}
 	}
 
@@ -3943,7 +4074,7 @@ static int zone_batchsize(struct zone *zone)
 static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 {
 	struct per_cpu_pages *pcp;
-	int migratetype;
+	int pindex;
 
 	memset(p, 0, sizeof(*p));
 
@@ -3951,8 +4082,15 @@ static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 	pcp->count = 0;
 	pcp->high = 6 * batch;
 	pcp->batch = max(1UL, 1 * batch);
-	for (migratetype = 0; migratetype < MIGRATE_PCPTYPES; migratetype++)
-		INIT_LIST_HEAD(&pcp->lists[migratetype]);
+	/*
+	 * Hoarded high-order blocks can no longer merge in the buddy lists,
+	 * so keep half as many pages on the high-order lists.
+	 */
+	pcp->high_order_count = 0;
+	pcp->high_order_high = pcp->high / 2;
+	pcp->high_order_batch = pcp->batch;
+	for (pindex = 0; pindex < NR_PCP_LISTS; pindex++)
+		INIT_LIST_HEAD(&pcp->lists[pindex]);
 }
 
 /*
@@ -3970,6 +4108,8 @@ static void setup_pagelist_highmark(struct per_cpu_pageset *p,
 	pcp->batch = max(1UL, high/4);
 	if ((high/4) > (PAGE_SHIFT * 8))
 		pcp->batch = PAGE_SHIFT * 8;
+	pcp->high_order_high = pcp->high / 2;
+	pcp->high_order_batch = pcp->batch;
 }
 
 static void setup_zone_pageset(struct zone *zone)
@@ -4060,6 +4200,7 @@ static int __zone_pcp_update(void *data)
 
 		local_irq_save(flags);
 		free_pcppages_bulk(zone, pcp->count, pcp);
+		free_pcppages_bulk_high(zone, pcp->high_order_count, pcp);
 		setup_pageset(pset, batch);
 		local_irq_restore(flags);
 	}
@@ -4500,6 +4641,9 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat,
 	pgdat->nr_zones = 0;
 	init_waitqueue_head(&pgdat->kswapd_wait);
 	pgdat->kswapd_max_order = 0;
+#ifdef CONFIG_COMPACTION
+	init_waitqueue_head(&pgdat->kcompactd_wait);
+#endif
 	pgdat_page_cgroup_init(pgdat);
 
 	for (j = 0; j < MAX_NR_ZONES; j++) {
@@ -473,7 +473,7 @@ void refresh_cpu_vm_stats(int cpu)
 		 * Check if there are pages remaining in this pageset
 		 * if not then there is nothing to expire.
 		 */
-		if (!p->expire || !p->pcp.count)
+		if (!p->expire || (!p->pcp.count && !p->pcp.high_order_count))
 			continue;
 
 		/*
@@ -488,7 +488,7 @@ void refresh_cpu_vm_stats(int cpu)
 		if (p->expire)
 			continue;
 
-		if (p->pcp.count)
+		if (p->pcp.count || p->pcp.high_order_count)
 			drain_zone_pages(zone, &p->pcp);
 #endif
 	}
@@ -743,6 +743,8 @@ const char * const vmstat_text[] = {
 	"pgfree",
 	"pgactivate",
 	"pgdeactivate",
+	"pcp_high_order_hit",
+	"pcp_high_order_miss",
 
 	"pgfault",
 	"pgmajfault",
@@ -774,6 +776,10 @@ const char * const vmstat_text[] = {
 	"compact_stall",
 	"compact_fail",
 	"compact_success",
+	"compact_stall_ms",
+	"compact_daemon_wake",
+	"compact_daemon_success",
+	"compact_daemon_migrated",
 #endif
 
 #ifdef CONFIG_HUGETLB_PAGE
@@ -788,6 +794,10 @@ const char * const vmstat_text[] = {
 	"unevictable_pgs_cleared",
 	"unevictable_pgs_stranded",
 	"unevictable_pgs_mlockfreed",
+#ifdef CONFIG_SWAP
+	"swap_ra",
+	"swap_ra_hit",
+#endif
 
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 	"thp_fault_alloc",
@@ -1015,11 +1025,17 @@ static void zoneinfo_show_print(struct seq_file *m, pg_data_t *pgdat,
 			   "\n    cpu: %i"
 			   "\n              count: %i"
 			   "\n              high:  %i"
-			   "\n              batch: %i",
+			   "\n              batch: %i"
+			   "\n   high_order_count: %i"
+			   "\n   high_order_high:  %i"
+			   "\n   high_order_batch: %i",
 			   i,
 			   pageset->pcp.count,
 			   pageset->pcp.high,
-			   pageset->pcp.batch);
+			   pageset->pcp.batch,
+			   pageset->pcp.high_order_count,
+			   pageset->pcp.high_order_high,
+			   pageset->pcp.high_order_batch);
 #ifdef CONFIG_SMP
 		seq_printf(m, "\n  vm stats threshold: %d",
 				pageset->stat_threshold);
@@ -0,0 +1,261 @@
+/*
+ * TCP Fast Open: server cookie generation and client cookie cache.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/crypto.h>
+#include <linux/err.h>
+#include <linux/hash.h>
+#include <linux/init.h>
+#include <linux/ipv6.h>
+#include <linux/jhash.h>
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/random.h>
+#include <linux/rcupdate.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/tcp.h>
+#include <net/net_namespace.h>
+#include <net/netns/hash.h>
+#include <net/tcp.h>
+
+int sysctl_tcp_fastopen __read_mostly = TFO_CLIENT_ENABLE;
+
+struct tcp_fastopen_context __rcu *tcp_fastopen_ctx;
+
+static DEFINE_SPINLOCK(tcp_fastopen_ctx_lock);
+
+static void tcp_fastopen_ctx_free(struct rcu_head *head)
+{
+	struct tcp_fastopen_context *ctx =
+	    container_of(head, struct tcp_fastopen_context, rcu);
+	crypto_free_cipher(ctx->tfm);
+	kfree(ctx);
+}
+
+int tcp_fastopen_reset_cipher(void *key, unsigned int len)
+{
+	int err;
+	struct tcp_fastopen_context *ctx, *octx;
+
+	ctx = kmalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return -ENOMEM;
+	ctx->tfm = crypto_alloc_cipher("aes", 0, 0);
+
+	if (IS_ERR(ctx->tfm)) {
+		err = PTR_ERR(ctx->tfm);
+error:		kfree(ctx);
+		pr_err("TCP: TFO aes cipher alloc error: %d\n", err);
+		return err;
+	}
+	err = crypto_cipher_setkey(ctx->tfm, key, len);
+	if (err) {
+		pr_err("TCP: TFO cipher key error: %d\n", err);
+		crypto_free_cipher(ctx->tfm);
+		goto error;
+	}
+	memcpy(ctx->key, key, len);
+
+	spin_lock(&tcp_fastopen_ctx_lock);
+
+	octx = rcu_dereference_protected(tcp_fastopen_ctx,
+				lockdep_is_held(&tcp_fastopen_ctx_lock));
+	rcu_assign_pointer(tcp_fastopen_ctx, ctx);
+	spin_unlock(&tcp_fastopen_ctx_lock);
+
+	if (octx)
+		call_rcu(&octx->rcu, tcp_fastopen_ctx_free);
+	return err;
+}
+
+/* Computes the fastopen cookie for the peer.
+ * The peer address is a 128 bits long (pad with zeros for IPv4).
+ *
+ * The caller must check foc->len to determine if a valid cookie
+ * has been generated successfully.
+ */
+void tcp_fastopen_cookie_gen(__be32 addr, struct tcp_fastopen_cookie *foc)
+{
+	__be32 peer_addr[4] = { addr, 0, 0, 0 };
+	struct tcp_fastopen_context *ctx;
+
+	rcu_read_lock();
+	ctx = rcu_dereference(tcp_fastopen_ctx);
+	if (ctx) {
+		crypto_cipher_encrypt_one(ctx->tfm,
+					  foc->val,
+					  (__u8 *)peer_addr);
+		foc->len = TCP_FASTOPEN_COOKIE_SIZE;
+	}
+	rcu_read_unlock();
+}
+
+/*
+ * Client side cache of what each server told us: the cookie it issued,
+ * the MSS it advertised and how often our SYN-data went unanswered.
+ * Entries are keyed by network namespace and destination address, a
+ * bucket holds at most TCP_FASTOPEN_CACHE_DEPTH entries and the least
+ * recently used one is recycled once it is full.
+ */
+struct tcp_fastopen_dst {
+	struct hlist_node		hnode;
+	struct net			*net;
+	unsigned short			family;
+	union {
+		__be32			a4;
+		struct in6_addr		a6;
+	} daddr;
+	unsigned long			stamp;		/* last use */
+	unsigned long			last_syn_loss;	/* last SYN loss */
+	int				syn_loss;	/* recurring SYN losses */
+	u16				mss;		/* server's MSS */
+	struct tcp_fastopen_cookie	cookie;		/* server's cookie */
+};
+
+#define TCP_FASTOPEN_CACHE_BITS		8
+#define TCP_FASTOPEN_CACHE_DEPTH	5
+
+static struct hlist_head tcp_fastopen_cache[1 << TCP_FASTOPEN_CACHE_BITS];
+static DEFINE_SPINLOCK(tcp_fastopen_cache_lock);
+
+/* Fill in the lookup key of @sk's peer and return its bucket */
+static struct hlist_head *tcp_fastopen_dst_key(const struct sock *sk,
+					       struct tcp_fastopen_dst *key)
+{
+	struct net *net = sock_net(sk);
+	u32 hash = 0;
+
+	memset(&key->daddr, 0, sizeof(key->daddr));
+	key->net = net;
+	key->family = sk->sk_family;
+	switch (sk->sk_family) {
+	case AF_INET:
+		key->daddr.a4 = inet_sk(sk)->inet_daddr;
+		hash = (__force u32)key->daddr.a4;
+		break;
+#if IS_ENABLED(CONFIG_IPV6)
+	case AF_INET6:
+		key->daddr.a6 = inet6_sk(sk)->daddr;
+		hash = jhash2((__force u32 *)key->daddr.a6.s6_addr32, 4, 0);
+		break;
+#endif
+	}
+	hash ^= net_hash_mix(net);
+	return &tcp_fastopen_cache[hash_32(hash, TCP_FASTOPEN_CACHE_BITS)];
+}
+
+static bool tcp_fastopen_dst_match(const struct tcp_fastopen_dst *d,
+				   const struct tcp_fastopen_dst *key)
+{
+	return net_eq(d->net, key->net) && d->family == key->family &&
+	       !memcmp(&d->daddr, &key->daddr, sizeof(key->daddr));
+}
+
+void tcp_fastopen_cache_get(struct sock *sk, u16 *mss,
+			    struct tcp_fastopen_cookie *cookie,
+			    int *syn_loss, unsigned long *last_syn_loss)
+{
+	struct tcp_fastopen_dst key, *d;
+	struct hlist_head *head = tcp_fastopen_dst_key(sk, &key);
+	struct hlist_node *pos;
+
+	spin_lock_bh(&tcp_fastopen_cache_lock);
+	hlist_for_each_entry(d, pos, head, hnode) {
+		if (!tcp_fastopen_dst_match(d, &key))
+			continue;
+		if (d->mss)
+			*mss = d->mss;
+		*cookie = d->cookie;
+		*syn_loss = d->syn_loss;
+		*last_syn_loss = *syn_loss ? d->last_syn_loss : 0;
+		d->stamp = jiffies;
+		break;
+	}
+	spin_unlock_bh(&tcp_fastopen_cache_lock);
+}
+
+void tcp_fastopen_cache_set(struct sock *sk, u16 mss,
+			    struct tcp_fastopen_cookie *cookie, bool syn_lost)
+{
+	struct tcp_fastopen_dst key, *d, *oldest = NULL;
+	struct hlist_head *head = tcp_fastopen_dst_key(sk, &key);
+	struct hlist_node *pos;
+	int depth = 0;
+
+	spin_lock_bh(&tcp_fastopen_cache_lock);
+	hlist_for_each_entry(d, pos, head, hnode) {
+		if (tcp_fastopen_dst_match(d, &key))
+			goto found;
+		if (!oldest || time_before(d->stamp, oldest->stamp))
+			oldest = d;
+		depth++;
+	}
+	if (depth >= TCP_FASTOPEN_CACHE_DEPTH) {
+		d = oldest;
+	} else {
+		d = kmalloc(sizeof(*d), GFP_ATOMIC);
+		if (!d)
+			goto out;
+		hlist_add_head(&d->hnode, head);
+	}
+	d->net = key.net;
+	d->family = key.family;
+	d->daddr = key.daddr;
+	d->mss = 0;
+	d->cookie.len = 0;
+	d->syn_loss = 0;
+	d->last_syn_loss = 0;
+found:
+	d->stamp = jiffies;
+	if (mss)
+		d->mss = mss;
+	if (cookie && cookie->len > 0)
+		d->cookie = *cookie;
+	if (syn_lost) {
+		++d->syn_loss;
+		d->last_syn_loss = jiffies;
+	} else
+		d->syn_loss = 0;
+out:
+	spin_unlock_bh(&tcp_fastopen_cache_lock);
+}
+
+static void __net_exit tcp_fastopen_net_exit(struct net *net)
+{
+	struct tcp_fastopen_dst *d;
+	struct hlist_node *pos, *n;
+	unsigned int i;
+
+	spin_lock_bh(&tcp_fastopen_cache_lock);
+	for (i = 0; i < ARRAY_SIZE(tcp_fastopen_cache); i++) {
+		hlist_for_each_entry_safe(d, pos, n, &tcp_fastopen_cache[i],
+					  hnode) {
+			if (!net_eq(d->net, net))
+				continue;
+			hlist_del(&d->hnode);
+			kfree(d);
+		}
+	}
+	spin_unlock_bh(&tcp_fastopen_cache_lock);
+}
+
+static struct pernet_operations tcp_fastopen_net_ops = {
+	.exit = tcp_fastopen_net_exit,
+};
+
+static int __init tcp_fastopen_init(void)
+{
+	__u8 key[TCP_FASTOPEN_KEY_LENGTH];
+
+	get_random_bytes(key, sizeof(key));
+	tcp_fastopen_reset_cipher(key, sizeof(key));
+	return register_pernet_subsys(&tcp_fastopen_net_ops);
+}
+
+late_initcall(tcp_fastopen_init);